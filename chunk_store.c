@@ -0,0 +1,786 @@
+#include "chunk_store.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HASH_LEN 32
+#define MANIFEST_MAGIC "CHUNKS2\n"
+#define MANIFEST_MAGIC_LEN 8
+
+// One manifest entry
+typedef struct
+{
+    unsigned char hash[HASH_LEN];
+    uint32_t len;
+} ChunkRef;
+
+// Stored chunk; refs counts manifest entries pointing at it (0 = deleted slot)
+struct ChunkEntry
+{
+    unsigned char hash[HASH_LEN];
+    uint32_t len;
+    uint32_t refs;
+    bool used;
+    bool writing; // first reference is still writing the chunk file
+    bool missing; // that write failed; the next reference writes it again
+};
+
+static bool enabled = false;
+static char chunk_dir[512];
+static uint64_t gear[256];
+
+static struct ChunkEntry *table = NULL;
+static size_t table_capacity = 0; // power of two
+static size_t table_used = 0;
+
+// table_lock 只保護 chunk table 的 refcount 與統計；chunk 檔案的讀寫在鎖外面做
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stored_cond = PTHREAD_COND_INITIALIZER; // 某個 chunk 寫完了
+
+// 每個 manifest 一把 rwlock (依路徑 hash 分到 FILE_LOCKS 把之一)：同一個檔案的讀可以並行，
+// 寫、刪要獨占；不同檔案互不影響
+#define FILE_LOCKS 64
+static pthread_rwlock_t file_locks[FILE_LOCKS];
+
+// Statistics (under table_lock)
+static uint64_t unique_chunks = 0;
+static uint64_t logical_bytes = 0; // sum of chunk references
+static uint64_t stored_bytes = 0;  // bytes in .chunks
+static uint64_t tail_bytes = 0;    // bytes in open tails, stored once per file
+static atomic_ullong client_bytes = 0;  // bytes clients asked to write
+static atomic_ullong written_bytes = 0; // chunk + manifest + tail bytes actually written
+
+// ---- SHA-256 ----
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t state[8], const unsigned char *block)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+static void sha256(const unsigned char *data, size_t len, unsigned char out[HASH_LEN])
+{
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+    size_t done = 0;
+    for (; done + 64 <= len; done += 64)
+        sha256_block(state, data + done);
+
+    // 最後一塊: 剩餘資料 + 0x80 + 補零 + 位元長度
+    unsigned char tail[128] = {0};
+    size_t rest = len - done;
+    memcpy(tail, data + done, rest);
+    tail[rest] = 0x80;
+    size_t tail_len = rest + 9 <= 64 ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; i++)
+        tail[tail_len - 1 - i] = bits >> (i * 8);
+    sha256_block(state, tail);
+    if (tail_len == 128)
+        sha256_block(state, tail + 64);
+
+    for (int i = 0; i < 8; i++)
+    {
+        out[i * 4] = state[i] >> 24;
+        out[i * 4 + 1] = state[i] >> 16;
+        out[i * 4 + 2] = state[i] >> 8;
+        out[i * 4 + 3] = state[i];
+    }
+}
+
+// ---- content-defined chunking ----
+
+static void gear_init(void)
+{
+    // 固定的種子，重啟後切點一樣，已存的 chunk 才能繼續去重
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < 256; i++)
+    {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+// Length of the next chunk: cut where the top CHUNK_AVG_BITS of the gear hash are zero,
+// between CHUNK_MIN and CHUNK_MAX. Cut points depend only on nearby bytes, so an edit
+// only changes the chunks around it
+static size_t next_cut(const unsigned char *p, size_t len)
+{
+    if (len <= CHUNK_MIN)
+        return len;
+    size_t max = len < CHUNK_MAX ? len : CHUNK_MAX;
+
+    uint64_t h = 0;
+    for (size_t i = CHUNK_MIN - 64; i < max; i++)
+    {
+        h = (h << 1) + gear[p[i]];
+        if (i >= CHUNK_MIN && (h >> (64 - CHUNK_AVG_BITS)) == 0)
+            return i + 1;
+    }
+    return max;
+}
+
+// ---- chunk table (caller holds table_lock) ----
+
+static struct ChunkEntry *chunk_slot(const unsigned char *hash, bool insert);
+
+static void table_grow(void)
+{
+    struct ChunkEntry *old = table;
+    size_t old_capacity = table_capacity;
+
+    table_capacity = old_capacity ? old_capacity * 2 : 1024;
+    table = calloc(table_capacity, sizeof(struct ChunkEntry));
+    table_used = 0;
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old[i].used && old[i].refs > 0)
+            *chunk_slot(old[i].hash, true) = old[i];
+    }
+    free(old);
+}
+
+static struct ChunkEntry *chunk_slot(const unsigned char *hash, bool insert)
+{
+    if (insert && (table_used + 1) * 10 > table_capacity * 7)
+        table_grow();
+    if (table_capacity == 0)
+        return NULL;
+
+    uint64_t key;
+    memcpy(&key, hash, sizeof(key)); // sha256 已經夠亂，直接當 hash 用
+    size_t mask = table_capacity - 1;
+    for (size_t i = key & mask;; i = (i + 1) & mask)
+    {
+        struct ChunkEntry *e = &table[i];
+        if (e->used && !memcmp(e->hash, hash, HASH_LEN))
+            return e;
+        if (!e->used)
+        {
+            if (!insert)
+                return NULL;
+            memset(e, 0, sizeof(*e));
+            memcpy(e->hash, hash, HASH_LEN);
+            e->used = true;
+            table_used++;
+            return e;
+        }
+    }
+}
+
+static void chunk_path(const unsigned char *hash, char *path, size_t len)
+{
+    char hex[HASH_LEN * 2 + 1];
+    for (int i = 0; i < HASH_LEN; i++)
+        sprintf(hex + i * 2, "%02x", hash[i]);
+    snprintf(path, len, "%s/%s", chunk_dir, hex);
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Write `len` bytes to `path` through a temporary file, so readers never see a partial file
+static int write_file_atomic(const char *path, const char *tmp_path, const void *head, size_t head_len,
+                             const void *data, size_t len)
+{
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    if (write_all(fd, head, head_len) < 0 || write_all(fd, data, len) < 0)
+    {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp_path, path) < 0)
+    {
+        unlink(tmp_path);
+        return -1;
+    }
+    atomic_fetch_add(&written_bytes, head_len + len);
+    return 0;
+}
+
+// Take a reference on a chunk. Returns true for the first reference: the caller must then
+// write the chunk file and call chunk_stored. A writer of another file that needs the same
+// chunk meanwhile waits, so no manifest is saved before its chunks are on disk.
+// on_disk: the file is known to exist (startup)
+static bool chunk_ref(const unsigned char *hash, uint32_t len, bool on_disk)
+{
+    pthread_mutex_lock(&table_lock);
+    struct ChunkEntry *e;
+    while ((e = chunk_slot(hash, true))->writing)
+        pthread_cond_wait(&stored_cond, &table_lock);
+
+    bool store = !on_disk && (e->refs == 0 || e->missing);
+    if (e->refs == 0)
+    {
+        e->len = len;
+        unique_chunks++;
+        stored_bytes += len;
+    }
+    e->writing = store;
+    e->missing = false;
+    e->refs++;
+    logical_bytes += len;
+    pthread_mutex_unlock(&table_lock);
+    return store;
+}
+
+static void chunk_stored(const unsigned char *hash, bool ok)
+{
+    pthread_mutex_lock(&table_lock);
+    struct ChunkEntry *e = chunk_slot(hash, false);
+    if (e)
+    {
+        e->writing = false;
+        e->missing = !ok;
+    }
+    pthread_cond_broadcast(&stored_cond);
+    pthread_mutex_unlock(&table_lock);
+}
+
+// Drop a reference; the chunk file is deleted with the last one
+static void chunk_unref(const unsigned char *hash)
+{
+    pthread_mutex_lock(&table_lock);
+    struct ChunkEntry *e = chunk_slot(hash, false);
+    if (e != NULL && e->refs > 0)
+    {
+        e->refs--;
+        logical_bytes -= e->len;
+        if (e->refs == 0)
+        {
+            // 在 table_lock 裡刪，新的第一個 reference 一定在刪完之後才會重寫
+            char path[600];
+            chunk_path(hash, path, sizeof(path));
+            unlink(path);
+            unique_chunks--;
+            stored_bytes -= e->len;
+        }
+    }
+    pthread_mutex_unlock(&table_lock);
+}
+
+// Reference `len` bytes of content as a chunk, writing the chunk file if it is new
+static int chunk_put(const unsigned char *data, uint32_t len, ChunkRef *ref)
+{
+    sha256(data, len, ref->hash);
+    ref->len = len;
+    if (!chunk_ref(ref->hash, len, false))
+        return 0;
+
+    char path[600], tmp_path[610];
+    chunk_path(ref->hash, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    bool ok = write_file_atomic(path, tmp_path, "", 0, data, len) == 0;
+    chunk_stored(ref->hash, ok);
+    if (!ok)
+    {
+        chunk_unref(ref->hash);
+        return -1;
+    }
+    return 0;
+}
+
+static void tail_changed(long delta)
+{
+    pthread_mutex_lock(&table_lock);
+    tail_bytes += delta;
+    pthread_mutex_unlock(&table_lock);
+}
+
+// ---- manifests and open tails ----
+
+static pthread_rwlock_t *file_lock(const char *path)
+{
+    uint32_t h = 2166136261u; // FNV-1a
+    for (; *path; path++)
+    {
+        h ^= (unsigned char)*path;
+        h *= 16777619u;
+    }
+    return &file_locks[h % FILE_LOCKS];
+}
+
+// The open tail of `path`: bytes after the last chunk that have no cut point yet, in
+// .<name>.tail.<gen> next to the manifest. Appends only add to it; once a cut point appears
+// the sealed part becomes chunks and the rest moves to the next generation
+static void tail_path(const char *path, uint32_t gen, char *out, size_t len)
+{
+    const char *slash = strrchr(path, '/');
+    if (slash)
+        snprintf(out, len, "%.*s/.%s.tail.%u", (int)(slash - path), path, slash + 1, gen);
+    else
+        snprintf(out, len, ".%s.tail.%u", path, gen);
+}
+
+static size_t tail_size(const char *tail)
+{
+    struct stat st;
+    return stat(tail, &st) == 0 ? (size_t)st.st_size : 0; // 沒有檔案 = 空的 tail
+}
+
+// Load the chunk list and tail generation of `path`; -1 if it is missing or not a manifest
+static int manifest_load(const char *path, ChunkRef **refs, uint32_t *count, uint32_t *tail_gen)
+{
+    *refs = NULL;
+    *count = 0;
+    *tail_gen = 0;
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return -1;
+
+    char magic[MANIFEST_MAGIC_LEN];
+    uint32_t n;
+    if (fread(magic, 1, MANIFEST_MAGIC_LEN, file) != MANIFEST_MAGIC_LEN || memcmp(magic, MANIFEST_MAGIC, MANIFEST_MAGIC_LEN) != 0 ||
+        fread(&n, sizeof(n), 1, file) != 1 || fread(tail_gen, sizeof(*tail_gen), 1, file) != 1)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    ChunkRef *list = malloc((n ? n : 1) * sizeof(ChunkRef));
+    if (list == NULL || fread(list, sizeof(ChunkRef), n, file) != n)
+    {
+        free(list);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    *refs = list;
+    *count = n;
+    return 0;
+}
+
+static int manifest_save(const char *path, const ChunkRef *refs, uint32_t count, uint32_t tail_gen)
+{
+    // 暫存檔用 . 開頭，不會跟使用者的檔名撞到
+    char tmp_path[600];
+    const char *slash = strrchr(path, '/');
+    if (slash)
+        snprintf(tmp_path, sizeof(tmp_path), "%.*s/.%s.tmp", (int)(slash - path), path, slash + 1);
+    else
+        snprintf(tmp_path, sizeof(tmp_path), ".%s.tmp", path);
+
+    char head[MANIFEST_MAGIC_LEN + 2 * sizeof(uint32_t)];
+    memcpy(head, MANIFEST_MAGIC, MANIFEST_MAGIC_LEN);
+    memcpy(head + MANIFEST_MAGIC_LEN, &count, sizeof(count));
+    memcpy(head + MANIFEST_MAGIC_LEN + sizeof(count), &tail_gen, sizeof(tail_gen));
+    return write_file_atomic(path, tmp_path, head, sizeof(head), refs, count * sizeof(ChunkRef));
+}
+
+// Read up to `len` bytes of `path` at `offset`; short only at the end of the file
+static ssize_t read_range(const char *path, char *buf, size_t len, off_t offset)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    size_t total = 0;
+    while (total < len)
+    {
+        ssize_t n = pread(fd, buf + total, len - total, offset + total);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        total += n;
+    }
+    close(fd);
+    return total;
+}
+
+static ssize_t chunk_read(const ChunkRef *ref, char *buf, size_t len, off_t offset)
+{
+    char path[600];
+    chunk_path(ref->hash, path, sizeof(path));
+    return read_range(path, buf, len, offset) == (ssize_t)len ? (ssize_t)len : -1;
+}
+
+// Drop the chunks and the tail of the manifest at `path` (caller holds its file lock)
+static void manifest_release(const char *path)
+{
+    ChunkRef *refs;
+    uint32_t count, gen;
+    if (manifest_load(path, &refs, &count, &gen) < 0)
+        return;
+    for (uint32_t i = 0; i < count; i++)
+        chunk_unref(refs[i].hash);
+    free(refs);
+
+    char tail[700];
+    tail_path(path, gen, tail, sizeof(tail));
+    tail_changed(-(long)tail_size(tail));
+    unlink(tail);
+}
+
+// ---- public API ----
+
+int chunk_store_open(const char *dir)
+{
+    snprintf(chunk_dir, sizeof(chunk_dir), "%s/%s", dir, CHUNK_DIR);
+    if (mkdir(chunk_dir, 0755) < 0 && errno != EEXIST)
+    {
+        perror("Failed to create chunk directory");
+        return -1;
+    }
+    gear_init();
+    for (int i = 0; i < FILE_LOCKS; i++)
+        pthread_rwlock_init(&file_locks[i], NULL);
+
+    // 從現有的 manifest 重建 refcount
+    DIR *d = opendir(dir);
+    if (d == NULL)
+    {
+        perror("Failed to open storage directory");
+        return -1;
+    }
+    int manifests = 0, orphans = 0;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL)
+    {
+        char path[600];
+        if (ent->d_name[0] == '.')
+        {
+            // 沒有 manifest 指到的 tail (換代或寫到一半留下的) 直接刪掉
+            const char *mark = NULL;
+            for (const char *p = strstr(ent->d_name, ".tail."); p; p = strstr(p + 1, ".tail."))
+                mark = p;
+            if (mark == NULL || mark == ent->d_name)
+                continue;
+
+            char *end;
+            unsigned long gen = strtoul(mark + 6, &end, 10);
+            snprintf(path, sizeof(path), "%s/%.*s", dir, (int)(mark - ent->d_name - 1), ent->d_name + 1);
+            ChunkRef *refs;
+            uint32_t count, manifest_gen;
+            bool live = false;
+            if (*end == '\0' && manifest_load(path, &refs, &count, &manifest_gen) == 0)
+            {
+                live = manifest_gen == gen;
+                free(refs);
+            }
+            if (!live)
+            {
+                char tail[800];
+                snprintf(tail, sizeof(tail), "%s/%s", dir, ent->d_name);
+                unlink(tail);
+                orphans++;
+            }
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+
+        ChunkRef *refs;
+        uint32_t count, gen;
+        if (manifest_load(path, &refs, &count, &gen) < 0)
+            continue;
+        for (uint32_t i = 0; i < count; i++)
+            chunk_ref(refs[i].hash, refs[i].len, true);
+        free(refs);
+
+        char tail[700];
+        tail_path(path, gen, tail, sizeof(tail));
+        tail_bytes += tail_size(tail);
+        manifests++;
+    }
+    closedir(d);
+
+    // 沒有 manifest 用到的 chunk (或寫到一半的暫存檔) 直接刪掉
+    int removed = 0;
+    d = opendir(chunk_dir);
+    while (d && (ent = readdir(d)) != NULL)
+    {
+        if (ent->d_name[0] == '.')
+            continue;
+        unsigned char hash[HASH_LEN];
+        bool valid = strlen(ent->d_name) == HASH_LEN * 2;
+        for (int i = 0; valid && i < HASH_LEN; i++)
+            valid = sscanf(ent->d_name + i * 2, "%2hhx", &hash[i]) == 1;
+
+        struct ChunkEntry *e = valid ? chunk_slot(hash, false) : NULL;
+        if (e == NULL || e->refs == 0)
+        {
+            char path[800];
+            snprintf(path, sizeof(path), "%s/%s", chunk_dir, ent->d_name);
+            unlink(path);
+            removed++;
+        }
+    }
+    if (d)
+        closedir(d);
+
+    enabled = true;
+    printf("Chunked storage: %d files, %lu chunks (%d unused chunks, %d stale tails removed)\n",
+           manifests, (unsigned long)unique_chunks, removed, orphans);
+    return 0;
+}
+
+bool chunk_store_enabled(void)
+{
+    return enabled;
+}
+
+int chunk_file_create(const char *path)
+{
+    pthread_rwlock_t *lock = file_lock(path);
+    pthread_rwlock_wrlock(lock);
+    manifest_release(path); // 同名的舊 manifest 先釋放
+    int rc = manifest_save(path, NULL, 0, 0);
+    pthread_rwlock_unlock(lock);
+    return rc;
+}
+
+ssize_t chunk_file_read(const char *path, char *buf, size_t len, off_t offset)
+{
+    pthread_rwlock_t *lock = file_lock(path);
+    pthread_rwlock_rdlock(lock);
+    ChunkRef *refs;
+    uint32_t count, gen;
+    if (manifest_load(path, &refs, &count, &gen) < 0)
+    {
+        pthread_rwlock_unlock(lock);
+        return -1;
+    }
+
+    size_t total = 0;
+    off_t start = 0; // file offset of chunk i
+    for (uint32_t i = 0; i < count && total < len; i++)
+    {
+        off_t end = start + refs[i].len;
+        off_t pos = offset + total;
+        if (pos < end)
+        {
+            size_t want = end - pos < (off_t)(len - total) ? (size_t)(end - pos) : len - total;
+            if (chunk_read(&refs[i], buf + total, want, pos - start) < 0)
+            {
+                free(refs);
+                pthread_rwlock_unlock(lock);
+                return -1;
+            }
+            total += want;
+        }
+        start = end;
+    }
+    free(refs);
+
+    // chunk 之後是 open tail
+    if (total < len)
+    {
+        char tail[700];
+        tail_path(path, gen, tail, sizeof(tail));
+        off_t pos = offset + total;
+        ssize_t n = read_range(tail, buf + total, len - total, pos > start ? pos - start : 0);
+        if (n > 0)
+            total += n;
+    }
+    pthread_rwlock_unlock(lock);
+    return total;
+}
+
+int chunk_file_write(const char *path, const char *content, size_t len, bool append, size_t *new_size)
+{
+    pthread_rwlock_t *lock = file_lock(path);
+    pthread_rwlock_wrlock(lock);
+    ChunkRef *old;
+    uint32_t old_count, gen;
+    if (manifest_load(path, &old, &old_count, &gen) < 0)
+    {
+        pthread_rwlock_unlock(lock);
+        return -1;
+    }
+    char old_tail[700];
+    tail_path(path, gen, old_tail, sizeof(old_tail));
+    size_t old_tail_len = tail_size(old_tail);
+
+    // 要切的資料：append 是舊 tail + 新內容 (前面的 chunk 不動)，overwrite 是整個新內容。
+    // 不到 CHUNK_MIN 不會有切點，舊 tail 不用讀
+    uint32_t keep = append ? old_count : 0;
+    size_t tail_len = append ? old_tail_len : 0;
+    bool scan = tail_len + len > CHUNK_MIN;
+    unsigned char *data = malloc(tail_len + len + 1);
+    if (data == NULL || (scan && tail_len > 0 && read_range(old_tail, (char *)data, tail_len, 0) != (ssize_t)tail_len))
+    {
+        free(data);
+        free(old);
+        pthread_rwlock_unlock(lock);
+        return -1;
+    }
+    memcpy(data + tail_len, content, len);
+    size_t data_len = tail_len + len;
+
+    // 有切點 (或滿 CHUNK_MAX) 的部分封成 chunk；最後沒有切點的部分留在 tail
+    ChunkRef *refs = malloc((keep + data_len / CHUNK_MIN + 1) * sizeof(ChunkRef));
+    uint32_t count = keep;
+    size_t pos = 0;
+    int rc = refs ? 0 : -1;
+    if (refs)
+        memcpy(refs, old, keep * sizeof(ChunkRef));
+    while (rc == 0 && pos < data_len)
+    {
+        size_t n = next_cut(data + pos, data_len - pos);
+        if (n == data_len - pos && n < CHUNK_MAX)
+            break;
+        rc = chunk_put(data + pos, n, &refs[count]);
+        if (rc == 0)
+            count++;
+        pos += n;
+    }
+    size_t rest = data_len - pos;
+
+    if (rc == 0 && append && count == keep)
+    {
+        // 沒有新的 chunk：新內容直接接在 tail 後面，manifest 不用重寫
+        int fd = open(old_tail, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        rc = fd < 0 || write_all(fd, content, len) < 0 ? -1 : 0;
+        if (fd >= 0)
+            close(fd);
+        if (rc == 0)
+        {
+            atomic_fetch_add(&written_bytes, len);
+            tail_changed(len);
+        }
+    }
+    else if (rc == 0)
+    {
+        // 換下一代 tail：先寫好新 tail，manifest 指過去才算生效，最後刪掉舊的
+        char new_tail[700], tmp_path[710];
+        tail_path(path, gen + 1, new_tail, sizeof(new_tail));
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", new_tail);
+        if (rest > 0)
+            rc = write_file_atomic(new_tail, tmp_path, "", 0, data + pos, rest);
+        if (rc == 0)
+            rc = manifest_save(path, refs, count, gen + 1);
+        if (rc == 0)
+        {
+            // 共用的 chunk 在上面已先加過 ref，這裡放掉被取代的
+            for (uint32_t i = keep; i < old_count; i++)
+                chunk_unref(old[i].hash);
+            unlink(old_tail);
+            tail_changed((long)rest - (long)old_tail_len);
+        }
+        else
+            unlink(new_tail);
+    }
+    free(data);
+
+    if (rc == 0)
+    {
+        atomic_fetch_add(&client_bytes, len);
+        *new_size = rest;
+        for (uint32_t i = 0; i < count; i++)
+            *new_size += refs[i].len;
+    }
+    else
+    {
+        for (uint32_t i = keep; i < count; i++)
+            chunk_unref(refs[i].hash);
+    }
+
+    free(refs);
+    free(old);
+    pthread_rwlock_unlock(lock);
+    return rc;
+}
+
+int chunk_file_remove(const char *path)
+{
+    pthread_rwlock_t *lock = file_lock(path);
+    pthread_rwlock_wrlock(lock);
+    manifest_release(path);
+    int rc = unlink(path);
+    pthread_rwlock_unlock(lock);
+    return rc;
+}
+
+void chunk_store_status(char *buf, size_t len)
+{
+    if (!enabled)
+    {
+        buf[0] = '\0';
+        return;
+    }
+
+    pthread_mutex_lock(&table_lock);
+    uint64_t files = logical_bytes + tail_bytes, stored = stored_bytes + tail_bytes;
+    double ratio = stored ? (double)files / stored : 1.0;
+    uint64_t saved = files - stored;
+    snprintf(buf, len,
+             "chunks: %lu unique, %lu bytes stored for %lu bytes of files (%lu in open tails)\n"
+             "dedup ratio %.2fx, saved %lu bytes (%.1f%%)\n"
+             "writes: %lu bytes from clients, %lu bytes written\n",
+             (unsigned long)unique_chunks, (unsigned long)stored, (unsigned long)files, (unsigned long)tail_bytes,
+             ratio, (unsigned long)saved, files ? 100.0 * saved / files : 0.0,
+             (unsigned long)atomic_load(&client_bytes), (unsigned long)atomic_load(&written_bytes));
+    pthread_mutex_unlock(&table_lock);
+}
@@ -0,0 +1,31 @@
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define CHUNK_DIR ".chunks"
+#define CHUNK_MIN (2 * 1024)
+#define CHUNK_AVG_BITS 13 // 平均 chunk 約 8 KB
+#define CHUNK_MAX (64 * 1024)
+
+// Enable chunked storage under `dir`: rebuild chunk refcounts from the manifests in it
+// and delete chunks nothing refers to
+int chunk_store_open(const char *dir);
+bool chunk_store_enabled(void);
+
+// Files are manifests (list of chunk hashes) at `path`; the data lives in `dir`/.chunks/<sha256>,
+// followed by the file's open tail (bytes without a cut point yet) in `dir`/.<name>.tail.<gen>
+int chunk_file_create(const char *path);
+ssize_t chunk_file_read(const char *path, char *buf, size_t len, off_t offset);
+
+// Overwrite or append; only chunks not already stored are written, and an append without a new
+// cut point only appends to the tail. *new_size is the file size afterwards
+int chunk_file_write(const char *path, const char *content, size_t len, bool append, size_t *new_size);
+int chunk_file_remove(const char *path);
+
+// Dedup ratio and space / write savings for the `stats` command
+void chunk_store_status(char *buf, size_t len);
+
+#endif
@@ -1,5 +1,34 @@
 #include "includes.h"
 #include <termios.h>
+#include <getopt.h>
+#include "shard.h"
+#include <pthread.h>
+
+#define MAX_WATCHES 64
+
+// Sharded mode: one connection per server in the shard map
+ShardMap shard_map;
+int shard_socks[MAX_SHARDS];
+bool sharded = false;
+
+// Server given by --host / --port, for extra connections
+const char *server_host = SERVER_ADDR;
+int server_port = PORT;
+
+// 每個 watch 用自己的連線和 thread，事件不會跟一般 request 的回覆混在一起
+int watch_socks[MAX_WATCHES];
+int watch_count = 0;
+pthread_mutex_t watch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int connect_server(const char *host, int port);
+
+// Socket of the server that owns `filename`
+int route(int sock_fd, const char *filename)
+{
+    if (!sharded)
+        return sock_fd;
+    return shard_socks[shard_owner(&shard_map, filename)];
+}
 
 // Print server response
 void print_server_response(int sock_fd)
@@ -89,6 +118,131 @@ void handle_write(struct User *user, int sock_fd, const char *command)
         perror("Failed to receive server response");
     return;
 }
+static int compare_lines(const void *a, const void *b)
+{
+    // ls 每行最後一欄是檔名
+    const char *x = strrchr(*(char *const *)a, ' ');
+    const char *y = strrchr(*(char *const *)b, ' ');
+    return strcmp(x ? x : *(char *const *)a, y ? y : *(char *const *)b);
+}
+
+// Send ls / search / stats to every shard; ls and search output is merged and sorted by filename
+void fan_out(ClientRequest *request)
+{
+    bool is_ls = strcmp(request->command, "ls") == 0 || strncmp(request->command, "search ", 7) == 0;
+    static char merged[MAX_SHARDS * BUFFER_SIZE];
+    static char *lines[MAX_SHARDS * BUFFER_SIZE / 2];
+    int line_count = 0;
+    size_t used = 0;
+    int omitted = 0; // search: matches a shard left out of its response
+
+    for (int s = 0; s < shard_map.count; s++)
+    {
+        Response res;
+        if (send(shard_socks[s], request, sizeof(*request), 0) < 0 ||
+            recv(shard_socks[s], &res, sizeof(Response), MSG_WAITALL) <= 0)
+        {
+            printf("[Shard %s:%d]: unreachable\n", shard_map.shards[s].host, shard_map.shards[s].port);
+            continue;
+        }
+
+        if (!is_ls)
+        {
+            printf("[Shard %s:%d]: %s\n%s", shard_map.shards[s].host, shard_map.shards[s].port, res.status, res.content);
+            continue;
+        }
+
+        int shown, total;
+        if (sscanf(res.status, "Truncated: %d of %d", &shown, &total) == 2)
+            omitted += total - shown;
+
+        size_t len = strlen(res.content);
+        memcpy(merged + used, res.content, len + 1);
+        for (char *line = strtok(merged + used, "\n"); line; line = strtok(NULL, "\n"))
+            lines[line_count++] = line;
+        used += len + 1;
+    }
+
+    if (is_ls)
+    {
+        qsort(lines, line_count, sizeof(char *), compare_lines);
+        if (omitted > 0)
+            printf("[Server]: Truncated: %d of %d matches\n", line_count, line_count + omitted);
+        else
+            printf("[Server]: SUCCESS\n");
+        if (line_count > 0)
+        {
+            printf("[Content]:\n");
+            for (int i = 0; i < line_count; i++)
+                printf("%s\n", lines[i]);
+        }
+    }
+}
+
+// Print events pushed on one watch connection until it is closed
+void *watch_thread(void *arg)
+{
+    int sock_fd = (int)(intptr_t)arg;
+    Response res;
+    while (recv(sock_fd, &res, sizeof(Response), MSG_WAITALL) == sizeof(Response))
+    {
+        if (strcmp(res.status, "EVENT") == 0)
+            printf("\n[Watch]: %s\n", res.content);
+        else
+            printf("\n[Watch]: %s %s\n", res.status, res.content);
+        fflush(stdout);
+    }
+    close(sock_fd);
+    return NULL;
+}
+
+// Open a watch connection to one server and start its event thread
+void start_watch(const char *host, int port, struct User *user, const char *pattern)
+{
+    pthread_mutex_lock(&watch_lock);
+    if (watch_count >= MAX_WATCHES)
+    {
+        pthread_mutex_unlock(&watch_lock);
+        printf("Too many watches\n");
+        return;
+    }
+
+    int sock_fd = connect_server(host, port);
+    if (sock_fd < 0)
+    {
+        pthread_mutex_unlock(&watch_lock);
+        return;
+    }
+
+    ClientRequest request;
+    memset(&request, 0, sizeof(request));
+    memcpy(&request.user, user, sizeof(struct User));
+    snprintf(request.command, sizeof(request.command), "watch %s", pattern);
+
+    pthread_t tid;
+    if (send(sock_fd, &request, sizeof(request), 0) < 0 ||
+        pthread_create(&tid, NULL, watch_thread, (void *)(intptr_t)sock_fd) != 0)
+    {
+        perror("Failed to start watch");
+        close(sock_fd);
+        pthread_mutex_unlock(&watch_lock);
+        return;
+    }
+    pthread_detach(tid);
+    watch_socks[watch_count++] = sock_fd;
+    pthread_mutex_unlock(&watch_lock);
+}
+
+// Close every watch connection; their threads exit on their own
+void stop_watches(void)
+{
+    pthread_mutex_lock(&watch_lock);
+    for (int i = 0; i < watch_count; i++)
+        shutdown(watch_socks[i], SHUT_RDWR);
+    watch_count = 0;
+    pthread_mutex_unlock(&watch_lock);
+}
+
 void client_handler(int sock_fd)
 {
     struct User user;
@@ -112,7 +266,7 @@ void client_handler(int sock_fd)
 
     while (1)
     {
-        printf("Enter command (create/read/write/mode/exit): ");
+        printf("Enter command (create/read/write/mode/ls/search/watch/unwatch/stats/exit): ");
         fflush(stdout);
 
         memset(command, 0, sizeof(command));
@@ -154,16 +308,17 @@ void client_handler(int sock_fd)
             memcpy(&request.user, &user, sizeof(struct User));
             snprintf(request.command, sizeof(request.command), "create %s %s", filename, permissions);
             printf("Sending create request to server ...\n");
+            int fd = route(sock_fd, filename);
 
-            if (send(sock_fd, &request, sizeof(request), 0) < 0)
+            if (send(fd, &request, sizeof(request), 0) < 0)
             {
                 perror("Failed to send create command");
-                close(sock_fd); // 確保關閉無效的 socket
+                close(fd); // 確保關閉無效的 socket
                 exit(EXIT_FAILURE);
             }
 
             // Receive and print server response
-            print_server_response(sock_fd);
+            print_server_response(fd);
         }
         else if (strncmp(command, "read", 4) == 0)
         {
@@ -179,13 +334,14 @@ void client_handler(int sock_fd)
             snprintf(request.command, sizeof(request.command), "read %s", filename);
 
             // Send read command to server
-            if (send(sock_fd, &request, sizeof(request), 0) < 0)
+            int fd = route(sock_fd, filename);
+            if (send(fd, &request, sizeof(request), 0) < 0)
             {
                 perror("Failed to send read command");
                 continue;
             }
             Response res;
-            if (recv(sock_fd, &res, sizeof(Response), 0) > 0)
+            if (recv(fd, &res, sizeof(Response), 0) > 0)
             {
                 printf("[Server]: %s\n", res.status);
                 if (strlen(res.content) > 0)
@@ -206,7 +362,7 @@ void client_handler(int sock_fd)
                 printf("Invalid format for write. Use: write <filename> <o/a>\n");
                 continue;
             }
-            handle_write(&user, sock_fd, command);
+            handle_write(&user, route(sock_fd, filename), command);
             continue;
         }
         else if (strncmp(command, "mode", 4) == 0)
@@ -229,22 +385,85 @@ void client_handler(int sock_fd)
             memcpy(&request.user, &user, sizeof(struct User));
             snprintf(request.command, sizeof(request.command), "mode %s %s", filename, permissions);
 
-            if (send(sock_fd, &request, sizeof(request), 0) < 0)
+            int fd = route(sock_fd, filename);
+            if (send(fd, &request, sizeof(request), 0) < 0)
             {
                 perror("Failed to send mode command");
                 continue;
             }
 
+            print_server_response(fd);
+        }
+        else if (strcmp(command, "ls") == 0 || strcmp(command, "stats") == 0 || strncmp(command, "search", 6) == 0)
+        {
+            if (strncmp(command, "search", 6) == 0 && (command[6] != ' ' || command[7] == '\0'))
+            {
+                printf("Invalid format for search. Use: search <text>\n");
+                continue;
+            }
+            if (strncmp(command, "search", 6) == 0 && strlen(command + 7) < 3)
+            {
+                printf("Search text needs at least 3 characters.\n");
+                continue;
+            }
+
+            ClientRequest request;
+            memset(&request, 0, sizeof(request));
+            memcpy(&request.user, &user, sizeof(struct User));
+            snprintf(request.command, sizeof(request.command), "%s", command);
+
+            if (sharded)
+            {
+                fan_out(&request);
+                continue;
+            }
+
+            if (send(sock_fd, &request, sizeof(request), 0) < 0)
+            {
+                perror("Failed to send command");
+                continue;
+            }
+
             print_server_response(sock_fd);
         }
+        else if (strncmp(command, "watch", 5) == 0)
+        {
+            char pattern[256];
+            if (sscanf(command, "watch %255s", pattern) != 1)
+            {
+                printf("Invalid format for watch. Use: watch <filename> or watch <prefix>*\n");
+                continue;
+            }
+
+            // 單一檔案只在擁有它的 shard 上；prefix 可能分散在每個 shard，每台 server 都要 watch
+            size_t pattern_len = strlen(pattern);
+            if (sharded && pattern[pattern_len - 1] != '*')
+            {
+                ShardEndpoint *owner = &shard_map.shards[shard_owner(&shard_map, pattern)];
+                start_watch(owner->host, owner->port, &user, pattern);
+            }
+            else if (sharded)
+            {
+                for (int s = 0; s < shard_map.count; s++)
+                    start_watch(shard_map.shards[s].host, shard_map.shards[s].port, &user, pattern);
+            }
+            else
+                start_watch(server_host, server_port, &user, pattern);
+        }
+        else if (strcmp(command, "unwatch") == 0)
+        {
+            stop_watches();
+            printf("Watches stopped\n");
+        }
         else
         {
-            printf("Unknown command. Supported commands are: create, read, write, mode, exit.\n");
+            printf("Unknown command. Supported commands are: create, read, write, mode, ls, search, watch, unwatch, stats, exit.\n");
             continue;
         }
     }
 }
-int main()
+// Connect to host:port; returns the socket or -1
+int connect_server(const char *host, int port)
 {
     int sock_fd;
     struct sockaddr_in server_addr;
@@ -253,16 +472,18 @@ int main()
     if ((sock_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
     {
         perror("Socket creation failed");
-        exit(EXIT_FAILURE);
+        return -1;
     }
 
     // Configure server address
+    memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(PORT);
-    if (inet_pton(AF_INET, SERVER_ADDR, &server_addr.sin_addr) <= 0)
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &server_addr.sin_addr) <= 0)
     {
         perror("Invalid address or Address not supported");
-        exit(EXIT_FAILURE);
+        close(sock_fd);
+        return -1;
     }
 
     // Connect to server
@@ -270,14 +491,78 @@ int main()
     {
         perror("Connection failed");
         close(sock_fd);
-        exit(EXIT_FAILURE);
+        return -1;
+    }
+    return sock_fd;
+}
+
+int main(int argc, char *argv[])
+{
+    int sock_fd;
+    const char *shard_file = NULL;
+
+    static struct option long_options[] = {
+        {"host", required_argument, NULL, 'h'},
+        {"port", required_argument, NULL, 'p'},
+        {"shards", required_argument, NULL, 's'},
+        {NULL, 0, NULL, 0}};
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'h':
+            server_host = optarg;
+            break;
+        case 'p':
+            server_port = atoi(optarg);
+            break;
+        case 's':
+            shard_file = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [--host ADDR] [--port N] [--shards FILE]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (shard_file)
+    {
+        // 每個 shard 一條連線，create/read/write/mode 依檔名的 hash 送到負責的 server
+        if (shard_map_load(shard_file, &shard_map) < 0)
+            exit(EXIT_FAILURE);
+        for (int i = 0; i < shard_map.count; i++)
+        {
+            shard_socks[i] = connect_server(shard_map.shards[i].host, shard_map.shards[i].port);
+            if (shard_socks[i] < 0)
+            {
+                fprintf(stderr, "Cannot connect to shard %s:%d\n", shard_map.shards[i].host, shard_map.shards[i].port);
+                exit(EXIT_FAILURE);
+            }
+        }
+        sharded = true;
+        sock_fd = shard_socks[0];
+        printf("Connected to %d shards successfully!\n", shard_map.count);
+    }
+    else
+    {
+        sock_fd = connect_server(server_host, server_port);
+        if (sock_fd < 0)
+            exit(EXIT_FAILURE);
+        printf("Connected to server successfully!\n");
     }
-    printf("Connected to server successfully!\n");
 
     client_handler(sock_fd);
 
     // Close socket
-    close(sock_fd);
+    if (sharded)
+    {
+        for (int i = 0; i < shard_map.count; i++)
+            close(shard_socks[i]);
+    }
+    else
+        close(sock_fd);
     printf("Connection closed.\n");
     return 0;
 }
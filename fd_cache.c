@@ -0,0 +1,188 @@
+#include "fd_cache.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// Cache slot
+struct FdSlot
+{
+    int entry; // capabilities[] index, -1 表示空的
+    int fd;
+    int refcount;
+    bool stale; // invalidated while still referenced
+    unsigned long last_used;
+};
+
+static struct FdSlot slots[FD_CACHE_SIZE];
+static unsigned long lru_clock = 0;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void fd_cache_init(void)
+{
+    pthread_mutex_lock(&cache_lock);
+    for (int i = 0; i < FD_CACHE_SIZE; i++)
+    {
+        slots[i].entry = -1;
+        slots[i].fd = -1;
+        slots[i].refcount = 0;
+        slots[i].stale = false;
+        slots[i].last_used = 0;
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// Caller holds cache_lock
+static int find_slot(int entry)
+{
+    for (int i = 0; i < FD_CACHE_SIZE; i++)
+    {
+        if (slots[i].entry == entry && !slots[i].stale)
+            return i;
+    }
+    return -1;
+}
+
+// Pick an empty slot, or the least recently used idle one. Caller holds cache_lock
+static int victim_slot(void)
+{
+    int victim = -1;
+    for (int i = 0; i < FD_CACHE_SIZE; i++)
+    {
+        if (slots[i].entry == -1)
+            return i;
+        if (slots[i].refcount == 0 && (victim == -1 || slots[i].last_used < slots[victim].last_used))
+            victim = i;
+    }
+    return victim;
+}
+
+int fd_cache_lookup(int entry, FdHandle *handle)
+{
+    pthread_mutex_lock(&cache_lock);
+    int slot = find_slot(entry);
+    if (slot >= 0)
+    {
+        slots[slot].refcount++;
+        slots[slot].last_used = ++lru_clock;
+        handle->fd = slots[slot].fd;
+        handle->slot = slot;
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return slot >= 0 ? 0 : -1;
+}
+
+void fd_cache_install(int entry, int fd, bool replace, FdHandle *handle)
+{
+    pthread_mutex_lock(&cache_lock);
+    int slot = find_slot(entry);
+    if (slot >= 0)
+    {
+        if (replace)
+        {
+            // 新建的檔案取代舊的 fd
+            slots[slot].stale = true;
+            if (slots[slot].refcount == 0)
+            {
+                close(slots[slot].fd);
+                slots[slot].entry = -1;
+                slots[slot].fd = -1;
+                slots[slot].stale = false;
+            }
+        }
+        else
+        {
+            // Another thread opened it first
+            close(fd);
+            slots[slot].refcount++;
+            slots[slot].last_used = ++lru_clock;
+            handle->fd = slots[slot].fd;
+            handle->slot = slot;
+            pthread_mutex_unlock(&cache_lock);
+            return;
+        }
+    }
+
+    slot = victim_slot();
+    if (slot >= 0)
+    {
+        if (slots[slot].entry != -1)
+            close(slots[slot].fd); // LRU close
+        slots[slot].entry = entry;
+        slots[slot].fd = fd;
+        slots[slot].refcount = 1;
+        slots[slot].stale = false;
+        slots[slot].last_used = ++lru_clock;
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    handle->fd = fd;
+    handle->slot = slot;
+}
+
+int fd_cache_acquire(int entry, const char *filepath, bool create, FdHandle *handle)
+{
+    if (!create && fd_cache_lookup(entry, handle) == 0)
+        return 0;
+
+    // Cache miss: open outside the lock so other files are not held up
+    int flags = O_RDWR | O_CLOEXEC;
+    if (create)
+        flags |= O_CREAT | O_TRUNC;
+    int fd = open(filepath, flags, 0644);
+    if (fd < 0)
+        return -1;
+
+    fd_cache_install(entry, fd, create, handle);
+    return 0;
+}
+
+void fd_cache_release(FdHandle *handle)
+{
+    if (handle->fd < 0)
+        return;
+
+    if (handle->slot < 0)
+    {
+        close(handle->fd);
+    }
+    else
+    {
+        pthread_mutex_lock(&cache_lock);
+        struct FdSlot *s = &slots[handle->slot];
+        if (s->fd == handle->fd && s->refcount > 0)
+        {
+            s->refcount--;
+            if (s->refcount == 0 && s->stale)
+            {
+                close(s->fd);
+                s->entry = -1;
+                s->fd = -1;
+                s->stale = false;
+            }
+        }
+        pthread_mutex_unlock(&cache_lock);
+    }
+    handle->fd = -1;
+    handle->slot = -1;
+}
+
+void fd_cache_invalidate(int entry)
+{
+    pthread_mutex_lock(&cache_lock);
+    int slot = find_slot(entry);
+    if (slot >= 0)
+    {
+        if (slots[slot].refcount == 0)
+        {
+            close(slots[slot].fd);
+            slots[slot].entry = -1;
+            slots[slot].fd = -1;
+        }
+        else
+        {
+            slots[slot].stale = true;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
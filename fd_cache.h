@@ -0,0 +1,32 @@
+#ifndef FD_CACHE_H
+#define FD_CACHE_H
+
+#include <stdbool.h>
+
+#define FD_CACHE_SIZE 32
+
+// Handle returned by fd_cache_acquire
+typedef struct
+{
+    int fd;
+    int slot; // -1: 沒有可用的 slot，release 時直接關閉
+} FdHandle;
+
+void fd_cache_init(void);
+
+// Get an open O_RDWR fd for capability entry `entry`, opening `filepath` on a miss
+int fd_cache_acquire(int entry, const char *filepath, bool create, FdHandle *handle);
+
+// Get the cached fd of `entry` without opening it; -1 on a miss
+int fd_cache_lookup(int entry, FdHandle *handle);
+
+// Put an fd the caller already opened into the cache (takes ownership of `fd`)
+void fd_cache_install(int entry, int fd, bool replace, FdHandle *handle);
+
+// Drop the reference taken by fd_cache_acquire
+void fd_cache_release(FdHandle *handle);
+
+// Forget the fd of `entry` (closed once the last reference is released)
+void fd_cache_invalidate(int entry);
+
+#endif
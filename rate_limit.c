@@ -0,0 +1,319 @@
+#include "rate_limit.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+#define RL_NAME_LEN 256
+
+enum
+{
+    SLOT_EMPTY,
+    SLOT_CLAIMED, // name is being written
+    SLOT_READY
+};
+
+struct LimitConfig
+{
+    uint64_t ops_rate;   // requests per second
+    uint64_t bytes_rate; // bytes per second
+    long quota;          // bytes of storage
+};
+
+// Token bucket kept as a GCRA "theoretical arrival time" so one CAS updates it
+struct Bucket
+{
+    uint64_t rate;
+    uint64_t tat; // ns, CLOCK_MONOTONIC
+};
+
+struct LimitEntry
+{
+    int state;
+    char name[RL_NAME_LEN];
+    struct Bucket ops;
+    struct Bucket bytes;
+    long quota;
+    long used;
+};
+
+struct LimitTable
+{
+    struct LimitEntry slots[RL_TABLE_SIZE];
+    struct LimitConfig defaults;
+    bool has_defaults;
+    struct LimitEntry overflow; // 表滿了以後，沒搶到位置的名稱共用這一個 (限制不會消失)
+};
+
+static struct LimitTable user_limits;
+static struct LimitTable group_limits;
+static bool enabled = false;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static uint32_t hash_name(const char *name)
+{
+    uint32_t h = 2166136261u; // FNV-1a
+    for (; *name; name++)
+    {
+        h ^= (unsigned char)*name;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void init_entry(struct LimitEntry *entry, const struct LimitConfig *config)
+{
+    entry->ops.rate = config->ops_rate;
+    entry->ops.tat = 0;
+    entry->bytes.rate = config->bytes_rate;
+    entry->bytes.tat = 0;
+    entry->quota = config->quota;
+    entry->used = 0;
+}
+
+// Find the entry of `name`, inserting it with `config` if missing. Lock-free:
+// an empty slot is claimed with CAS and published once its name is written.
+// Probing stops after RL_MAX_PROBE slots; slots are never freed, so a name that
+// found no slot never gets one later and always maps to the same overflow entry
+static struct LimitEntry *table_get(struct LimitTable *table, const char *name, const struct LimitConfig *config)
+{
+    uint32_t idx = hash_name(name) & (RL_TABLE_SIZE - 1);
+    for (int probe = 0; probe < RL_MAX_PROBE; probe++)
+    {
+        struct LimitEntry *entry = &table->slots[(idx + probe) & (RL_TABLE_SIZE - 1)];
+        int state = __atomic_load_n(&entry->state, __ATOMIC_ACQUIRE);
+
+        if (state == SLOT_EMPTY)
+        {
+            if (config == NULL)
+                return NULL;
+            int expected = SLOT_EMPTY;
+            if (__atomic_compare_exchange_n(&entry->state, &expected, SLOT_CLAIMED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                strncpy(entry->name, name, RL_NAME_LEN - 1);
+                entry->name[RL_NAME_LEN - 1] = '\0';
+                init_entry(entry, config);
+                __atomic_store_n(&entry->state, SLOT_READY, __ATOMIC_RELEASE);
+                return entry;
+            }
+            state = expected;
+        }
+
+        // 其他執行緒正在寫入名稱，稍等它發布
+        while (state == SLOT_CLAIMED)
+            state = __atomic_load_n(&entry->state, __ATOMIC_ACQUIRE);
+
+        if (strncmp(entry->name, name, RL_NAME_LEN - 1) == 0)
+            return entry;
+    }
+    return config ? &table->overflow : NULL;
+}
+
+static struct LimitEntry *lookup(struct LimitTable *table, const char *name)
+{
+    return table_get(table, name, table->has_defaults ? &table->defaults : NULL);
+}
+
+// Take `cost` tokens; the bucket holds one second worth of tokens
+static bool bucket_take(struct Bucket *bucket, uint64_t cost)
+{
+    if (bucket->rate == 0 || cost == 0)
+        return true;
+
+    uint64_t now = now_ns();
+    uint64_t increment = cost * NSEC_PER_SEC / bucket->rate;
+    uint64_t tolerance = increment > NSEC_PER_SEC ? increment : NSEC_PER_SEC;
+
+    uint64_t tat = __atomic_load_n(&bucket->tat, __ATOMIC_RELAXED);
+    while (1)
+    {
+        uint64_t new_tat = (tat > now ? tat : now) + increment;
+        if (new_tat - now > tolerance)
+            return false;
+        if (__atomic_compare_exchange_n(&bucket->tat, &tat, new_tat, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return true;
+    }
+}
+
+// Give back `cost` tokens taken by bucket_take
+static void bucket_refund(struct Bucket *bucket, uint64_t cost)
+{
+    if (bucket->rate == 0 || cost == 0)
+        return;
+    __atomic_fetch_sub(&bucket->tat, cost * NSEC_PER_SEC / bucket->rate, __ATOMIC_RELAXED);
+}
+
+// 先扣使用者自己的 bucket，再扣 group 的；group 拒絕時把使用者的退回去，
+// 這樣一個被自己的限制擋下的使用者不會耗掉同組其他人的額度
+static bool take_both(struct Bucket *user, struct Bucket *group, uint64_t cost)
+{
+    if (user && !bucket_take(user, cost))
+        return false;
+    if (group && !bucket_take(group, cost))
+    {
+        if (user)
+            bucket_refund(user, cost);
+        return false;
+    }
+    return true;
+}
+
+bool rate_limit_enabled(void)
+{
+    return enabled;
+}
+
+bool rate_limit_allow_op(const char *user, const char *group)
+{
+    if (!enabled)
+        return true;
+
+    struct LimitEntry *u = lookup(&user_limits, user);
+    struct LimitEntry *g = lookup(&group_limits, group);
+    return take_both(u ? &u->ops : NULL, g ? &g->ops : NULL, 1);
+}
+
+bool rate_limit_allow_bytes(const char *user, const char *group, size_t bytes)
+{
+    if (!enabled)
+        return true;
+
+    struct LimitEntry *u = lookup(&user_limits, user);
+    struct LimitEntry *g = lookup(&group_limits, group);
+    return take_both(u ? &u->bytes : NULL, g ? &g->bytes : NULL, bytes);
+}
+
+// Add `delta` to the entry's usage unless that would go over its quota
+static bool usage_add(struct LimitEntry *entry, long delta, bool check)
+{
+    long used = __atomic_load_n(&entry->used, __ATOMIC_RELAXED);
+    while (1)
+    {
+        if (check && delta > 0 && entry->quota > 0 && used + delta > entry->quota)
+            return false;
+        if (__atomic_compare_exchange_n(&entry->used, &used, used + delta, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return true;
+    }
+}
+
+bool quota_reserve(const char *owner, const char *group, long delta)
+{
+    if (!enabled)
+        return true;
+
+    struct LimitEntry *u = lookup(&user_limits, owner);
+    struct LimitEntry *g = lookup(&group_limits, group);
+    if (u && !usage_add(u, delta, true))
+        return false;
+    if (g && !usage_add(g, delta, true))
+    {
+        if (u)
+            usage_add(u, -delta, false);
+        return false;
+    }
+    return true;
+}
+
+void quota_release(const char *owner, const char *group, long delta)
+{
+    if (!enabled || delta == 0)
+        return;
+
+    struct LimitEntry *u = lookup(&user_limits, owner);
+    struct LimitEntry *g = lookup(&group_limits, group);
+    if (u)
+        usage_add(u, -delta, false);
+    if (g)
+        usage_add(g, -delta, false);
+}
+
+int rate_limit_load(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        perror("Failed to open limits file");
+        return -1;
+    }
+
+    char line[512];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        line_no++;
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0')
+            continue;
+
+        char kind[16], name[RL_NAME_LEN];
+        int consumed;
+        if (sscanf(p, "%15s %255s%n", kind, name, &consumed) != 2)
+        {
+            fprintf(stderr, "%s:%d: expected <user|group> <name> [ops=N] [bytes=N] [quota=N]\n", path, line_no);
+            fclose(file);
+            return -1;
+        }
+
+        struct LimitTable *table;
+        if (!strcmp(kind, "user"))
+            table = &user_limits;
+        else if (!strcmp(kind, "group"))
+            table = &group_limits;
+        else
+        {
+            fprintf(stderr, "%s:%d: unknown kind '%s'\n", path, line_no, kind);
+            fclose(file);
+            return -1;
+        }
+
+        struct LimitConfig config = {0, 0, 0};
+        char *token = strtok(p + consumed, " \t\n");
+        for (; token; token = strtok(NULL, " \t\n"))
+        {
+            unsigned long long value;
+            if (sscanf(token, "ops=%llu", &value) == 1)
+                config.ops_rate = value;
+            else if (sscanf(token, "bytes=%llu", &value) == 1)
+                config.bytes_rate = value;
+            else if (sscanf(token, "quota=%llu", &value) == 1)
+                config.quota = (long)value;
+            else
+            {
+                fprintf(stderr, "%s:%d: unknown setting '%s'\n", path, line_no, token);
+                fclose(file);
+                return -1;
+            }
+        }
+
+        if (!strcmp(name, "*"))
+        {
+            table->defaults = config;
+            table->has_defaults = true;
+            init_entry(&table->overflow, &config);
+        }
+        else
+        {
+            struct LimitEntry *entry = table_get(table, name, &config);
+            if (entry == &table->overflow)
+            {
+                fprintf(stderr, "%s:%d: too many names hash near '%s'\n", path, line_no, name);
+                fclose(file);
+                return -1;
+            }
+            if (entry)
+                init_entry(entry, &config);
+        }
+    }
+
+    fclose(file);
+    enabled = true;
+    return 0;
+}
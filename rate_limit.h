@@ -0,0 +1,30 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RL_TABLE_SIZE 1024 // per kind (users / groups), power of two
+#define RL_MAX_PROBE 32     // names that find no slot within this many probes share one default bucket
+
+// Load limits from `path`. Lines look like:
+//   user  alice         ops=50  bytes=1048576 quota=10485760
+//   group CSE-students  ops=200 bytes=4194304 quota=104857600
+//   user  *             ops=20                                (default for other users)
+// 0 or a missing key means unlimited
+int rate_limit_load(const char *path);
+bool rate_limit_enabled(void);
+
+// Take one request token from the user's and the group's bucket
+bool rate_limit_allow_op(const char *user, const char *group);
+
+// Take `bytes` byte tokens from the user's and the group's bucket
+bool rate_limit_allow_bytes(const char *user, const char *group, size_t bytes);
+
+// Reserve `delta` bytes of storage for the file owner and group; false if a quota would be exceeded
+bool quota_reserve(const char *owner, const char *group, long delta);
+
+// Give back (or, if negative, add) storage without checking the quota
+void quota_release(const char *owner, const char *group, long delta);
+
+#endif
@@ -0,0 +1,296 @@
+#include "includes.h"
+#include "shard.h"
+
+// Identity accepted by the server's admin commands (names/export/import/drop/thaw)
+#define ADMIN_USER "rebalance"
+#define ADMIN_GROUP "admin"
+
+// Filenames collected from one shard before anything is moved
+struct NameList
+{
+    char (*names)[256];
+    int count;
+    int capacity;
+};
+
+int connect_server(const char *host, int port)
+{
+    int sock_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock_fd < 0)
+    {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &server_addr.sin_addr) <= 0 ||
+        connect(sock_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+    {
+        fprintf(stderr, "Cannot connect to %s:%d\n", host, port);
+        close(sock_fd);
+        return -1;
+    }
+    return sock_fd;
+}
+
+int recv_all(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int send_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Send one admin command and wait for its response
+int request(int fd, const char *command, Response *res)
+{
+    ClientRequest req;
+    memset(&req, 0, sizeof(req));
+    strncpy(req.user.name, ADMIN_USER, sizeof(req.user.name) - 1);
+    strncpy(req.user.group, ADMIN_GROUP, sizeof(req.user.group) - 1);
+    snprintf(req.command, sizeof(req.command), "%s", command);
+
+    if (send_all(fd, &req, sizeof(req)) < 0 || recv_all(fd, res, sizeof(*res)) < 0)
+        return -1;
+    return 0;
+}
+
+// Page through "names <slot>" until the shard has no more files. Each page starts with
+// "next <slot>", where the following page begins
+int collect_names(int fd, struct NameList *list)
+{
+    list->count = 0;
+    int next = 0;
+    while (1)
+    {
+        char command[64];
+        Response res;
+        snprintf(command, sizeof(command), "names %d", next);
+        if (request(fd, command, &res) < 0 || strcmp(res.status, "SUCCESS") != 0 ||
+            sscanf(res.content, "next %d", &next) != 1)
+            return -1;
+
+        int added = 0;
+        char *names = strchr(res.content, '\n');
+        for (char *name = names ? strtok(names + 1, "\n") : NULL; name; name = strtok(NULL, "\n"))
+        {
+            if (list->count == list->capacity)
+            {
+                int capacity = list->capacity ? list->capacity * 2 : 64;
+                void *names = realloc(list->names, capacity * sizeof(*list->names));
+                if (names == NULL)
+                    return -1;
+                list->names = names;
+                list->capacity = capacity;
+            }
+            snprintf(list->names[list->count++], sizeof(list->names[0]), "%s", name);
+            added++;
+        }
+        if (added == 0)
+            return 0;
+    }
+}
+
+// Undo the export of `filename` on the source shard. After a failed transfer the connection
+// is in the middle of the content, so it is replaced by a new one first
+bool thaw_source(int *src, const ShardEndpoint *from, const char *filename, bool reconnect)
+{
+    if (reconnect)
+    {
+        close(*src);
+        *src = connect_server(from->host, from->port);
+        if (*src < 0)
+        {
+            fprintf(stderr, "  %s stays frozen on %s:%d, thaw it by hand\n", filename, from->host, from->port);
+            return false;
+        }
+    }
+
+    char command[BUFFER_SIZE];
+    Response res;
+    snprintf(command, sizeof(command), "thaw %s", filename);
+    if (request(*src, command, &res) < 0 || strcmp(res.status, "File thawed") != 0)
+    {
+        fprintf(stderr, "  thaw %s failed\n", filename);
+        return false;
+    }
+    return true;
+}
+
+// export from src -> import into dst -> drop from src. Every failure after the export thaws
+// the file on src again
+bool move_file(int *src, const ShardEndpoint *from, int dst, const char *filename)
+{
+    char command[BUFFER_SIZE];
+    Response res;
+
+    snprintf(command, sizeof(command), "export %s", filename);
+    if (request(*src, command, &res) < 0)
+    {
+        fprintf(stderr, "  export %s failed\n", filename);
+        thaw_source(src, from, filename, true); // 不知道 server 有沒有收到 export
+        return false;
+    }
+    if (strcmp(res.status, "SUCCESS") != 0)
+    {
+        fprintf(stderr, "  export %s failed: %s\n", filename, res.status);
+        return false;
+    }
+
+    char owner[50], group[50], permissions[7];
+    unsigned long size;
+    int consumed = 0;
+    if (sscanf(res.content, "%49s %49s %6s %lu %n", owner, group, permissions, &size, &consumed) != 4 || consumed == 0)
+    {
+        fprintf(stderr, "  export %s: bad metadata '%s'\n", filename, res.content);
+        thaw_source(src, from, filename, true); // 不知道後面跟著多少 bytes
+        return false;
+    }
+    char last_modified[20];
+    snprintf(last_modified, sizeof(last_modified), "%s", res.content + consumed);
+
+    char *content = malloc(size ? size : 1);
+    if (content == NULL || recv_all(*src, content, size) < 0)
+    {
+        free(content);
+        fprintf(stderr, "  export %s: content transfer failed\n", filename);
+        thaw_source(src, from, filename, true);
+        return false;
+    }
+
+    bool ok = false;
+    snprintf(command, sizeof(command), "import %s %s %s %s %lu %s", filename, owner, group, permissions, size, last_modified);
+    if (request(dst, command, &res) == 0 && strcmp(res.status, "Ready for import") == 0 &&
+        send_all(dst, content, size) == 0 && recv_all(dst, &res, sizeof(res)) == 0 &&
+        strcmp(res.status, "File imported") == 0)
+    {
+        ok = true;
+    }
+    else
+    {
+        fprintf(stderr, "  import %s failed: %s\n", filename, res.status);
+    }
+    free(content);
+
+    if (!ok)
+    {
+        thaw_source(src, from, filename, false);
+        return false;
+    }
+
+    snprintf(command, sizeof(command), "drop %s", filename);
+    if (request(*src, command, &res) < 0 || strcmp(res.status, "File dropped") != 0)
+        fprintf(stderr, "  drop %s failed, the file is now on both shards\n", filename);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    bool dry_run = argc == 4 && !strcmp(argv[3], "--dry-run");
+    if (argc != 3 && !dry_run)
+    {
+        fprintf(stderr, "Usage: %s OLD_SHARD_MAP NEW_SHARD_MAP [--dry-run]\n", argv[0]);
+        fprintf(stderr, "Moves every file whose owner changes between the two maps, with its capability.\n");
+        return 1;
+    }
+
+    static ShardMap old_map, new_map;
+    if (shard_map_load(argv[1], &old_map) < 0 || shard_map_load(argv[2], &new_map) < 0)
+        return 1;
+
+    int new_socks[MAX_SHARDS];
+    for (int i = 0; i < new_map.count; i++)
+    {
+        new_socks[i] = dry_run ? -1 : connect_server(new_map.shards[i].host, new_map.shards[i].port);
+        if (!dry_run && new_socks[i] < 0)
+            return 1;
+    }
+
+    // 先列出每個舊 shard 的檔案再開始搬，搬過去的檔案才不會在後面的 shard 又被算一次
+    static struct NameList lists[MAX_SHARDS];
+    int srcs[MAX_SHARDS];
+    int total = 0, moved = 0, failed = 0;
+
+    for (int s = 0; s < old_map.count; s++)
+    {
+        ShardEndpoint *from = &old_map.shards[s];
+        srcs[s] = connect_server(from->host, from->port);
+        if (srcs[s] < 0)
+            return 1;
+        if (collect_names(srcs[s], &lists[s]) < 0)
+        {
+            fprintf(stderr, "Failed to list files on %s:%d\n", from->host, from->port);
+            return 1;
+        }
+        total += lists[s].count;
+    }
+
+    for (int s = 0; s < old_map.count; s++)
+    {
+        ShardEndpoint *from = &old_map.shards[s];
+        struct NameList *list = &lists[s];
+        int src = srcs[s];
+
+        int leaving = 0;
+        for (int i = 0; i < list->count; i++)
+        {
+            int owner = shard_owner(&new_map, list->names[i]);
+            ShardEndpoint *to = &new_map.shards[owner];
+            if (to->port == from->port && !strcmp(to->host, from->host))
+                continue; // 擁有者沒變
+
+            leaving++;
+            printf("%s: %s:%d -> %s:%d\n", list->names[i], from->host, from->port, to->host, to->port);
+            if (dry_run)
+                continue;
+            if (src < 0)
+            {
+                failed++; // 連線斷了，又重連不上
+                continue;
+            }
+            if (move_file(&src, from, new_socks[owner], list->names[i]))
+                moved++;
+            else
+                failed++;
+        }
+        printf("[%s:%d] %d files, %d leaving\n", from->host, from->port, list->count, leaving);
+        if (src >= 0)
+            close(src);
+        free(list->names);
+    }
+
+    if (dry_run)
+        printf("Dry run: %d files checked\n", total);
+    else
+        printf("Moved %d of %d files (%d failed)\n", moved, total, failed);
+
+    for (int i = 0; i < new_map.count; i++)
+    {
+        if (new_socks[i] >= 0)
+            close(new_socks[i]);
+    }
+    return failed ? 1 : 0;
+}
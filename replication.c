@@ -0,0 +1,655 @@
+#include "replication.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_STANDBYS 16
+
+// Sent by a standby right after connecting; epoch 0 = no state to resume from
+typedef struct
+{
+    uint64_t epoch;
+    uint64_t from_seq;
+} ReplHello;
+
+struct LogEntry
+{
+    ReplRecord record;
+    char *content;
+};
+
+// A connected standby, as seen by the primary
+struct StandbyLink
+{
+    bool active;  // slot in use until the sender thread exits
+    bool closing; // ack reader saw the connection close
+    char addr[64];
+    int socket;
+    uint64_t sent;
+    uint64_t acked;
+    bool syncing; // sending a snapshot
+};
+
+static enum { ROLE_NONE, ROLE_PRIMARY, ROLE_STANDBY } role = ROLE_NONE;
+
+// Primary side. log_lock 保護 log 與 standbys
+static uint64_t log_epoch = 0;
+static struct LogEntry *log_entries = NULL; // seq log_base + 1 .. log_count
+static uint64_t log_count = 0;              // seq of the newest record (seq starts at 1)
+static uint64_t log_base = 0;               // records up to this seq were dropped
+static size_t log_bytes = 0;                // content bytes held by log_entries
+static size_t log_capacity = 0;
+static repl_snapshot_fn take_snapshot;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+static struct StandbyLink standbys[MAX_STANDBYS];
+
+// Standby side
+static char primary_host[64];
+static int primary_port;
+static repl_apply_fn apply_record;
+static pthread_mutex_t standby_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool standby_connected = false;
+static uint64_t standby_epoch = 0; // epoch of the primary we are in sync with, 0 while (re)syncing
+static uint64_t applied_seq = 0;
+static uint64_t primary_head = 0;
+static uint64_t lag_ms = 0;
+
+static uint64_t wall_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int send_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int recv_all(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static uint64_t new_epoch(void)
+{
+    uint64_t epoch = 0;
+    if (getrandom(&epoch, sizeof(epoch), 0) != sizeof(epoch))
+        epoch = wall_ms() ^ ((uint64_t)getpid() << 32);
+    return epoch ? epoch : 1;
+}
+
+bool repl_is_primary(void)
+{
+    return role == ROLE_PRIMARY;
+}
+
+bool repl_is_standby(void)
+{
+    return role == ROLE_STANDBY;
+}
+
+void repl_record_init(ReplRecord *record, enum ReplOp op, const char *filename, const char *owner, const char *group,
+                      const char *permissions, const char *write_mode, const char *last_modified,
+                      size_t length, size_t size)
+{
+    memset(record, 0, sizeof(*record));
+    record->op = op;
+    record->length = length;
+    record->size = size;
+    strncpy(record->filename, filename, sizeof(record->filename) - 1);
+    strncpy(record->owner, owner, sizeof(record->owner) - 1);
+    strncpy(record->group, group, sizeof(record->group) - 1);
+    strncpy(record->permissions, permissions, sizeof(record->permissions) - 1);
+    if (write_mode)
+        strncpy(record->write_mode, write_mode, sizeof(record->write_mode) - 1);
+    strncpy(record->last_modified, last_modified, sizeof(record->last_modified) - 1);
+}
+
+// Drop the oldest records once the log is over its limits (caller holds log_lock).
+// 一次砍到上限的 3/4，memmove 不會每筆都做
+static void log_trim(void)
+{
+    if (log_count - log_base <= REPL_LOG_MAX_RECORDS && log_bytes <= REPL_LOG_MAX_BYTES)
+        return;
+
+    size_t kept = log_count - log_base;
+    size_t drop = 0;
+    while (drop < kept && (kept - drop > REPL_LOG_MAX_RECORDS / 4 * 3 || log_bytes > REPL_LOG_MAX_BYTES / 4 * 3))
+    {
+        log_bytes -= log_entries[drop].record.length;
+        free(log_entries[drop].content);
+        drop++;
+    }
+    memmove(log_entries, log_entries + drop, (kept - drop) * sizeof(struct LogEntry));
+    log_base += drop;
+}
+
+void repl_log(enum ReplOp op, const char *filename, const char *owner, const char *group,
+              const char *permissions, const char *write_mode, const char *last_modified,
+              const char *content, size_t length, size_t size)
+{
+    if (role != ROLE_PRIMARY)
+        return;
+
+    char *copy = NULL;
+    if (length > 0)
+    {
+        copy = malloc(length);
+        if (copy == NULL)
+        {
+            perror("Replication log allocation failed");
+            return;
+        }
+        memcpy(copy, content, length);
+    }
+
+    pthread_mutex_lock(&log_lock);
+    if (log_count - log_base == log_capacity)
+    {
+        size_t capacity = log_capacity ? log_capacity * 2 : 256;
+        struct LogEntry *entries = realloc(log_entries, capacity * sizeof(struct LogEntry));
+        if (entries == NULL)
+        {
+            pthread_mutex_unlock(&log_lock);
+            perror("Replication log allocation failed");
+            free(copy);
+            return;
+        }
+        log_entries = entries;
+        log_capacity = capacity;
+    }
+
+    struct LogEntry *entry = &log_entries[log_count - log_base];
+    repl_record_init(&entry->record, op, filename, owner, group, permissions, write_mode, last_modified, length, size);
+    entry->record.epoch = log_epoch;
+    entry->record.seq = log_count + 1;
+    entry->record.committed_ms = wall_ms();
+    entry->content = copy;
+    log_count++;
+    log_bytes += length;
+    log_trim();
+
+    pthread_cond_broadcast(&log_cond);
+    pthread_mutex_unlock(&log_lock);
+}
+
+// Reads acks from one standby until its connection closes
+static void *ack_loop(void *arg)
+{
+    struct StandbyLink *link = arg;
+    uint64_t acked;
+    while (recv_all(link->socket, &acked, sizeof(acked)) == 0)
+    {
+        pthread_mutex_lock(&log_lock);
+        link->acked = acked;
+        pthread_mutex_unlock(&log_lock);
+    }
+
+    pthread_mutex_lock(&log_lock);
+    link->closing = true;
+    pthread_cond_broadcast(&log_cond);
+    pthread_mutex_unlock(&log_lock);
+    return NULL;
+}
+
+static bool snapshot_emit(void *arg, const ReplRecord *record, const char *content)
+{
+    struct StandbyLink *link = arg;
+    ReplRecord copy = *record;
+    copy.epoch = log_epoch;
+    copy.seq = 0;
+    copy.committed_ms = wall_ms();
+    pthread_mutex_lock(&log_lock);
+    copy.head = log_count;
+    pthread_mutex_unlock(&log_lock);
+
+    return send_all(link->socket, &copy, sizeof(copy)) == 0 &&
+           (copy.length == 0 || send_all(link->socket, content, copy.length) == 0);
+}
+
+// Full resync: RESET, the current files, then SYNCED carrying the seq the log continues from.
+// 快照的起點先取，之後的變動都還在 log 裡；重播到快照已含的變動是冪等的 (append 靠 record.size 判斷)
+static bool send_snapshot(struct StandbyLink *link, uint64_t *next)
+{
+    pthread_mutex_lock(&log_lock);
+    uint64_t seq = log_count;
+    link->syncing = true;
+    pthread_mutex_unlock(&log_lock);
+
+    uint64_t start_ms = wall_ms();
+    ReplRecord marker;
+    repl_record_init(&marker, REPL_RESET, "", "", "", "", NULL, "", 0, 0);
+    if (!snapshot_emit(link, &marker, NULL) || !take_snapshot(snapshot_emit, link))
+        return false;
+
+    repl_record_init(&marker, REPL_SYNCED, "", "", "", "", NULL, "", 0, 0);
+    marker.epoch = log_epoch;
+    marker.seq = seq;
+    marker.committed_ms = wall_ms();
+    marker.head = seq;
+    if (send_all(link->socket, &marker, sizeof(marker)) < 0)
+        return false;
+
+    pthread_mutex_lock(&log_lock);
+    link->syncing = false;
+    link->sent = seq;
+    pthread_mutex_unlock(&log_lock);
+    printf("[REPL] Sent snapshot up to seq %lu to standby %s in %lu ms\n", (unsigned long)seq, link->addr, (unsigned long)(wall_ms() - start_ms));
+    *next = seq + 1;
+    return true;
+}
+
+// Streams the log to one standby. A standby of the same epoch resumes from the seq it asked
+// for if the log still has it; anything else gets a snapshot first
+static void *sender_loop(void *arg)
+{
+    struct StandbyLink *link = arg;
+    ReplHello hello;
+    if (recv_all(link->socket, &hello, sizeof(hello)) < 0)
+    {
+        close(link->socket);
+        pthread_mutex_lock(&log_lock);
+        link->active = false;
+        pthread_mutex_unlock(&log_lock);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&log_lock);
+    uint64_t next = hello.from_seq;
+    bool resync = true;
+    if (hello.epoch == 0)
+        printf("[REPL] Standby %s has no state, sending a snapshot\n", link->addr);
+    else if (hello.epoch != log_epoch)
+        printf("[REPL] Standby %s followed another primary run (epoch %016lx), sending a snapshot\n", link->addr, (unsigned long)hello.epoch);
+    else if (next <= log_base || next > log_count + 1)
+        printf("[REPL] Standby %s asked for seq %lu but the log holds %lu..%lu, sending a snapshot\n",
+               link->addr, (unsigned long)next, (unsigned long)log_base + 1, (unsigned long)log_count);
+    else
+    {
+        resync = false;
+        link->acked = next - 1;
+        printf("[REPL] Standby %s connected, streaming from seq %lu\n", link->addr, (unsigned long)next);
+    }
+    pthread_mutex_unlock(&log_lock);
+
+    pthread_t ack_thread;
+    if (pthread_create(&ack_thread, NULL, ack_loop, link) != 0)
+    {
+        close(link->socket);
+        pthread_mutex_lock(&log_lock);
+        link->active = false;
+        pthread_mutex_unlock(&log_lock);
+        return NULL;
+    }
+
+    while (1)
+    {
+        if (resync && !send_snapshot(link, &next))
+            break;
+        resync = false;
+
+        pthread_mutex_lock(&log_lock);
+        while (!link->closing && next > log_count)
+            pthread_cond_wait(&log_cond, &log_lock);
+        if (link->closing)
+        {
+            pthread_mutex_unlock(&log_lock);
+            break;
+        }
+        if (next <= log_base)
+        {
+            // 落後太多，要的 record 已經被砍掉
+            printf("[REPL] Standby %s fell behind the log (needs seq %lu, log starts at %lu), sending a snapshot\n",
+                   link->addr, (unsigned long)next, (unsigned long)log_base + 1);
+            pthread_mutex_unlock(&log_lock);
+            resync = true;
+            continue;
+        }
+
+        // 複製出來再送：送的時候 log_trim 可能把這筆 free 掉
+        struct LogEntry *entry = &log_entries[next - log_base - 1];
+        ReplRecord record = entry->record;
+        record.head = log_count;
+        char *content = NULL;
+        if (record.length > 0 && (content = malloc(record.length)) != NULL)
+            memcpy(content, entry->content, record.length);
+        pthread_mutex_unlock(&log_lock);
+
+        bool sent = (record.length == 0 || content != NULL) &&
+                    send_all(link->socket, &record, sizeof(record)) == 0 &&
+                    (record.length == 0 || send_all(link->socket, content, record.length) == 0);
+        free(content);
+        if (!sent)
+            break;
+
+        pthread_mutex_lock(&log_lock);
+        link->sent = next;
+        pthread_mutex_unlock(&log_lock);
+        next++;
+    }
+
+    shutdown(link->socket, SHUT_RDWR);
+    pthread_join(ack_thread, NULL);
+    close(link->socket);
+    printf("[REPL] Standby %s disconnected\n", link->addr);
+
+    pthread_mutex_lock(&log_lock);
+    link->active = false;
+    pthread_mutex_unlock(&log_lock);
+    return NULL;
+}
+
+static void *primary_accept_loop(void *arg)
+{
+    int listen_fd = *(int *)arg;
+    free(arg);
+
+    while (1)
+    {
+        struct sockaddr_in addr;
+        socklen_t addr_len = sizeof(addr);
+        int fd = accept(listen_fd, (struct sockaddr *)&addr, &addr_len);
+        if (fd < 0)
+        {
+            perror("Replication accept failed");
+            continue;
+        }
+
+        pthread_mutex_lock(&log_lock);
+        struct StandbyLink *link = NULL;
+        for (int i = 0; i < MAX_STANDBYS; i++)
+        {
+            if (!standbys[i].active)
+            {
+                link = &standbys[i];
+                break;
+            }
+        }
+        if (link == NULL)
+        {
+            pthread_mutex_unlock(&log_lock);
+            fprintf(stderr, "[REPL] Too many standbys, rejecting connection\n");
+            close(fd);
+            continue;
+        }
+        memset(link, 0, sizeof(*link));
+        link->active = true;
+        link->socket = fd;
+        snprintf(link->addr, sizeof(link->addr), "%s:%d", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+        pthread_mutex_unlock(&log_lock);
+
+        pthread_t thread_id;
+        if (pthread_create(&thread_id, NULL, sender_loop, link) != 0)
+        {
+            perror("Replication thread creation failed");
+            close(fd);
+            pthread_mutex_lock(&log_lock);
+            link->active = false;
+            pthread_mutex_unlock(&log_lock);
+            continue;
+        }
+        pthread_detach(thread_id);
+    }
+    return NULL;
+}
+
+int repl_primary_start(int port, repl_snapshot_fn snapshot)
+{
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0)
+    {
+        perror("Replication socket failed");
+        return -1;
+    }
+
+    int on = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, MAX_STANDBYS) < 0)
+    {
+        perror("Replication listen failed");
+        close(listen_fd);
+        return -1;
+    }
+
+    int *fd_ptr = malloc(sizeof(int));
+    if (fd_ptr == NULL)
+    {
+        close(listen_fd);
+        return -1;
+    }
+    *fd_ptr = listen_fd;
+
+    take_snapshot = snapshot;
+    log_epoch = new_epoch();
+    role = ROLE_PRIMARY;
+    pthread_t thread_id;
+    if (pthread_create(&thread_id, NULL, primary_accept_loop, fd_ptr) != 0)
+    {
+        role = ROLE_NONE;
+        close(listen_fd);
+        free(fd_ptr);
+        return -1;
+    }
+    pthread_detach(thread_id);
+    return 0;
+}
+
+static int connect_primary(void)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(primary_port);
+    if (inet_pton(AF_INET, primary_host, &addr.sin_addr) <= 0 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Follow the primary. A restarted standby (epoch 0) or one whose primary restarted is sent a
+// snapshot; after a dropped connection it resumes from its last applied seq
+static void *standby_loop(void *arg)
+{
+    (void)arg;
+    bool warned = false;
+
+    while (1)
+    {
+        int fd = connect_primary();
+        if (fd < 0)
+        {
+            if (!warned)
+                fprintf(stderr, "[REPL] Cannot reach primary %s:%d, retrying\n", primary_host, primary_port);
+            warned = true;
+            sleep(1);
+            continue;
+        }
+        warned = false;
+
+        pthread_mutex_lock(&standby_lock);
+        ReplHello hello = {standby_epoch, applied_seq + 1};
+        standby_connected = true;
+        pthread_mutex_unlock(&standby_lock);
+
+        uint64_t start_ms = wall_ms();
+        uint64_t replayed = 0;
+        bool caught_up = false;
+        printf("[REPL] Connected to primary %s:%d, requesting from seq %lu\n", primary_host, primary_port, (unsigned long)hello.from_seq);
+
+        if (send_all(fd, &hello, sizeof(hello)) == 0)
+        {
+            ReplRecord record;
+            while (recv_all(fd, &record, sizeof(record)) == 0)
+            {
+                char *content = malloc(record.length + 1);
+                if (content == NULL || (record.length > 0 && recv_all(fd, content, record.length) < 0))
+                {
+                    free(content);
+                    break;
+                }
+                content[record.length] = '\0';
+
+                pthread_mutex_lock(&standby_lock);
+                bool in_sync = standby_epoch != 0;
+                pthread_mutex_unlock(&standby_lock);
+
+                if (record.seq != 0 && record.op != REPL_SYNCED && (!in_sync || record.epoch != standby_epoch))
+                {
+                    // 不該發生：primary 換了 epoch 卻沒先送快照。丟掉狀態，重連後整個重同步
+                    fprintf(stderr, "[REPL] Seq %lu is from epoch %016lx, expected %016lx; resyncing\n",
+                            (unsigned long)record.seq, (unsigned long)record.epoch, (unsigned long)standby_epoch);
+                    free(content);
+                    pthread_mutex_lock(&standby_lock);
+                    standby_epoch = 0;
+                    applied_seq = 0;
+                    pthread_mutex_unlock(&standby_lock);
+                    break;
+                }
+
+                if (record.op == REPL_RESET)
+                {
+                    printf("[REPL] Primary epoch %016lx: dropping local state for a full resync\n", (unsigned long)record.epoch);
+                    pthread_mutex_lock(&standby_lock);
+                    standby_epoch = 0; // 快照收完 (REPL_SYNCED) 前斷線，下次重連再要一次快照
+                    applied_seq = 0;
+                    pthread_mutex_unlock(&standby_lock);
+                }
+                if (record.op != REPL_SYNCED && !apply_record(&record, content))
+                    fprintf(stderr, "[REPL] Failed to apply seq %lu (%s)\n", (unsigned long)record.seq, record.filename);
+                free(content);
+                replayed++;
+
+                // 快照中的 record 沒有 seq，不更新 applied_seq 也不 ack
+                bool logged = record.seq != 0 || record.op == REPL_SYNCED;
+                uint64_t now = wall_ms();
+                pthread_mutex_lock(&standby_lock);
+                if (record.op == REPL_SYNCED)
+                    standby_epoch = record.epoch;
+                if (logged)
+                    applied_seq = record.seq;
+                primary_head = record.head > record.seq ? record.head : record.seq;
+                lag_ms = now > record.committed_ms ? now - record.committed_ms : 0;
+                bool done = logged && applied_seq >= primary_head;
+                pthread_mutex_unlock(&standby_lock);
+
+                if (logged && send_all(fd, &record.seq, sizeof(record.seq)) < 0)
+                    break;
+
+                if (!caught_up && done)
+                {
+                    caught_up = true;
+                    printf("[REPL] Caught up to seq %lu: %lu records in %lu ms\n", (unsigned long)record.seq, (unsigned long)replayed, (unsigned long)(now - start_ms));
+                }
+            }
+        }
+
+        close(fd);
+        pthread_mutex_lock(&standby_lock);
+        standby_connected = false;
+        pthread_mutex_unlock(&standby_lock);
+        fprintf(stderr, "[REPL] Lost connection to primary, reconnecting\n");
+        sleep(1);
+    }
+    return NULL;
+}
+
+int repl_standby_start(const char *host, int port, repl_apply_fn apply)
+{
+    strncpy(primary_host, host, sizeof(primary_host) - 1);
+    primary_port = port;
+    apply_record = apply;
+    role = ROLE_STANDBY;
+
+    pthread_t thread_id;
+    if (pthread_create(&thread_id, NULL, standby_loop, NULL) != 0)
+    {
+        role = ROLE_NONE;
+        return -1;
+    }
+    pthread_detach(thread_id);
+    return 0;
+}
+
+void repl_status(char *buf, size_t len)
+{
+    size_t used = 0;
+    buf[0] = '\0';
+
+    if (role == ROLE_PRIMARY)
+    {
+        pthread_mutex_lock(&log_lock);
+        used += snprintf(buf + used, len - used, "role: primary, epoch %016lx, log seq %lu..%lu (%lu KB)\n",
+                         (unsigned long)log_epoch, (unsigned long)log_base + 1, (unsigned long)log_count, (unsigned long)(log_bytes / 1024));
+        for (int i = 0; i < MAX_STANDBYS && used < len; i++)
+        {
+            if (!standbys[i].active || standbys[i].closing)
+                continue;
+            if (standbys[i].syncing)
+            {
+                used += snprintf(buf + used, len - used, "standby %s: receiving snapshot\n", standbys[i].addr);
+                continue;
+            }
+            used += snprintf(buf + used, len - used, "standby %s: sent %lu, acked %lu, lag %lu records\n",
+                             standbys[i].addr, (unsigned long)standbys[i].sent, (unsigned long)standbys[i].acked, (unsigned long)(log_count - standbys[i].acked));
+        }
+        pthread_mutex_unlock(&log_lock);
+    }
+    else if (role == ROLE_STANDBY)
+    {
+        pthread_mutex_lock(&standby_lock);
+        snprintf(buf, len, "role: standby of %s:%d (%s), epoch %016lx\napplied seq %lu, primary head %lu, lag %lu records / %lu ms\n",
+                 primary_host, primary_port, standby_connected ? "connected" : "disconnected", (unsigned long)standby_epoch,
+                 (unsigned long)applied_seq, (unsigned long)primary_head,
+                 (unsigned long)(primary_head - applied_seq), (unsigned long)lag_ms);
+        pthread_mutex_unlock(&standby_lock);
+    }
+    else
+    {
+        snprintf(buf, len, "role: standalone\n");
+    }
+}
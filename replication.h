@@ -0,0 +1,74 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum ReplOp
+{
+    REPL_CREATE = 1,
+    REPL_WRITE,
+    REPL_MODE,
+    REPL_DROP,
+    REPL_RESET, // snapshot start: the standby removes every file before the snapshot records
+    REPL_SYNCED // snapshot end: the standby follows the primary's log from here
+};
+
+// Log kept in memory for standbys that reconnect; older records are dropped, and a standby
+// that needs them gets a snapshot of the current files instead
+#define REPL_LOG_MAX_RECORDS 4096
+#define REPL_LOG_MAX_BYTES (64 * 1024 * 1024)
+
+// One entry of the replication log, followed on the wire by `length` content bytes
+typedef struct
+{
+    uint64_t epoch; // random per primary run; seqs of different epochs are unrelated
+    uint64_t seq;   // 0 for snapshot records
+    uint64_t head;         // primary's newest seq when this record was sent
+    uint64_t committed_ms; // wall clock time the primary committed the change
+    uint32_t op;
+    uint32_t length;
+    uint64_t size; // file size after the change, lets a replayed append be detected
+    char filename[256];
+    char owner[50];
+    char group[50];
+    char permissions[8];
+    char write_mode[2]; // "o" / "a" for REPL_WRITE
+    char last_modified[20];
+} ReplRecord;
+
+// Applies a record on the standby; returns false if it could not be applied
+typedef bool (*repl_apply_fn)(const ReplRecord *record, const char *content);
+
+// Sends one snapshot record to a standby; false once the standby is gone
+typedef bool (*repl_emit_fn)(void *link, const ReplRecord *record, const char *content);
+
+// Emits a REPL_CREATE and a REPL_WRITE ("o") record for every file on the primary
+typedef bool (*repl_snapshot_fn)(repl_emit_fn emit, void *link);
+
+// Primary: accept standbys on `port` and stream the log to them. A standby of another
+// epoch, or one behind the start of the log, is resynced from `snapshot`
+int repl_primary_start(int port, repl_snapshot_fn snapshot);
+
+// Standby: follow the primary at host:port, reconnecting when the link drops
+int repl_standby_start(const char *host, int port, repl_apply_fn apply);
+
+bool repl_is_primary(void);
+bool repl_is_standby(void);
+
+// Fill in the file fields of a record
+void repl_record_init(ReplRecord *record, enum ReplOp op, const char *filename, const char *owner, const char *group,
+                      const char *permissions, const char *write_mode, const char *last_modified,
+                      size_t length, size_t size);
+
+// Append a committed change to the log (no-op unless running as primary). `size` is the
+// file size afterwards
+void repl_log(enum ReplOp op, const char *filename, const char *owner, const char *group,
+              const char *permissions, const char *write_mode, const char *last_modified,
+              const char *content, size_t length, size_t size);
+
+// Human readable replication state for the `stats` command
+void repl_status(char *buf, size_t len);
+
+#endif
@@ -0,0 +1,746 @@
+#include "search_index.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NAME_LEN 256
+
+// Journal record types
+#define REC_SET 'S'
+#define REC_ADD 'A'
+#define REC_DEL 'D'
+
+// Sorted doc ids of every file containing one trigram
+struct Posting
+{
+    uint32_t trigram;
+    bool used;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *docs;
+};
+
+// One indexed file
+struct Doc
+{
+    char name[NAME_LEN];
+    bool live;
+    uint32_t *trigrams; // sorted, unique
+    uint32_t count;
+    unsigned char tail[2]; // last bytes of the content, for trigrams spanning an append
+    uint8_t tail_len;
+};
+
+static struct Posting *postings = NULL;
+static size_t posting_capacity = 0; // power of two
+static size_t posting_used = 0;
+
+static struct Doc *docs = NULL;
+static uint32_t doc_count = 0;
+static uint32_t doc_capacity = 0;
+static int32_t *name_table = NULL; // name hash -> doc id, -1 表示空
+static size_t name_capacity = 0;
+
+static pthread_rwlock_t index_lock = PTHREAD_RWLOCK_INITIALIZER;
+static FILE *journal = NULL;
+static char journal_path[512];
+static size_t journal_size = 0;  // bytes in the journal file
+static size_t snapshot_size = 0; // bytes right after the last compaction
+
+// 背景壓縮：compacting 由 index_lock 保護，compact_wanted 由 compact_lock 保護。
+// 壓縮期間新的紀錄寫進 delta_path，換檔時再接到快照後面
+static char delta_path[520];
+static bool compacting = false;
+static bool compact_wanted = false;
+static pthread_mutex_t compact_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t compact_cond = PTHREAD_COND_INITIALIZER;
+
+static uint32_t hash_u32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint32_t hash_name(const char *name)
+{
+    uint32_t h = 2166136261u; // FNV-1a
+    for (; *name; name++)
+    {
+        h ^= (unsigned char)*name;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Sorted, unique trigrams of `len` bytes; caller frees *out
+static uint32_t extract_trigrams(const unsigned char *p, size_t len, uint32_t **out)
+{
+    *out = NULL;
+    if (len < 3)
+        return 0;
+
+    uint32_t *tris = malloc((len - 2) * sizeof(uint32_t));
+    if (tris == NULL)
+        return 0;
+    for (size_t i = 0; i + 2 < len; i++)
+        tris[i] = (uint32_t)p[i] << 16 | (uint32_t)p[i + 1] << 8 | p[i + 2];
+    qsort(tris, len - 2, sizeof(uint32_t), compare_u32);
+
+    uint32_t n = 0;
+    for (size_t i = 0; i < len - 2; i++)
+    {
+        if (n == 0 || tris[n - 1] != tris[i])
+            tris[n++] = tris[i];
+    }
+    *out = tris;
+    return n;
+}
+
+// ---- posting table (caller holds the write lock) ----
+
+static struct Posting *posting_slot(uint32_t trigram, bool insert);
+
+static void posting_grow(void)
+{
+    struct Posting *old = postings;
+    size_t old_capacity = posting_capacity;
+
+    posting_capacity = old_capacity ? old_capacity * 2 : 4096;
+    postings = calloc(posting_capacity, sizeof(struct Posting));
+    posting_used = 0;
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (!old[i].used)
+            continue;
+        struct Posting *p = posting_slot(old[i].trigram, true);
+        *p = old[i];
+    }
+    free(old);
+}
+
+static struct Posting *posting_slot(uint32_t trigram, bool insert)
+{
+    if (insert && (posting_used + 1) * 10 > posting_capacity * 7)
+        posting_grow();
+    if (posting_capacity == 0)
+        return NULL;
+
+    size_t mask = posting_capacity - 1;
+    for (size_t i = hash_u32(trigram) & mask;; i = (i + 1) & mask)
+    {
+        struct Posting *p = &postings[i];
+        if (p->used && p->trigram == trigram)
+            return p;
+        if (!p->used)
+        {
+            if (!insert)
+                return NULL;
+            memset(p, 0, sizeof(*p));
+            p->used = true;
+            p->trigram = trigram;
+            posting_used++;
+            return p;
+        }
+    }
+}
+
+static size_t lower_bound(const uint32_t *a, uint32_t n, uint32_t key)
+{
+    size_t lo = 0, hi = n;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a[mid] < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void posting_add(uint32_t trigram, uint32_t doc)
+{
+    struct Posting *p = posting_slot(trigram, true);
+    size_t pos = lower_bound(p->docs, p->count, doc);
+    if (pos < p->count && p->docs[pos] == doc)
+        return;
+
+    if (p->count == p->capacity)
+    {
+        uint32_t capacity = p->capacity ? p->capacity * 2 : 4;
+        uint32_t *grown = realloc(p->docs, capacity * sizeof(uint32_t));
+        if (grown == NULL)
+            return;
+        p->docs = grown;
+        p->capacity = capacity;
+    }
+    memmove(p->docs + pos + 1, p->docs + pos, (p->count - pos) * sizeof(uint32_t));
+    p->docs[pos] = doc;
+    p->count++;
+}
+
+static void posting_remove(uint32_t trigram, uint32_t doc)
+{
+    struct Posting *p = posting_slot(trigram, false);
+    if (p == NULL)
+        return;
+    size_t pos = lower_bound(p->docs, p->count, doc);
+    if (pos < p->count && p->docs[pos] == doc)
+    {
+        memmove(p->docs + pos, p->docs + pos + 1, (p->count - pos - 1) * sizeof(uint32_t));
+        p->count--;
+    }
+}
+
+// ---- doc table (caller holds the write lock) ----
+
+static int32_t doc_find(const char *name)
+{
+    if (name_capacity == 0)
+        return -1;
+    size_t mask = name_capacity - 1;
+    for (size_t i = hash_name(name) & mask; name_table[i] >= 0; i = (i + 1) & mask)
+    {
+        if (!strcmp(docs[name_table[i]].name, name))
+            return name_table[i];
+    }
+    return -1;
+}
+
+static void name_insert(uint32_t id)
+{
+    size_t mask = name_capacity - 1;
+    size_t i = hash_name(docs[id].name) & mask;
+    while (name_table[i] >= 0)
+        i = (i + 1) & mask;
+    name_table[i] = id;
+}
+
+// Id of `name`, creating an empty doc if needed
+static int32_t doc_get(const char *name)
+{
+    int32_t id = doc_find(name);
+    if (id >= 0)
+        return id;
+
+    if (doc_count == doc_capacity)
+    {
+        uint32_t capacity = doc_capacity ? doc_capacity * 2 : 256;
+        struct Doc *grown = realloc(docs, capacity * sizeof(struct Doc));
+        if (grown == NULL)
+            return -1;
+        docs = grown;
+        doc_capacity = capacity;
+    }
+    if ((doc_count + 1) * 2 > name_capacity)
+    {
+        free(name_table);
+        name_capacity = name_capacity ? name_capacity * 2 : 512;
+        name_table = malloc(name_capacity * sizeof(int32_t));
+        memset(name_table, 0xff, name_capacity * sizeof(int32_t));
+        for (uint32_t d = 0; d < doc_count; d++)
+            name_insert(d);
+    }
+
+    id = doc_count++;
+    memset(&docs[id], 0, sizeof(docs[id]));
+    strncpy(docs[id].name, name, NAME_LEN - 1);
+    name_insert(id);
+    return id;
+}
+
+// Replace the doc's trigram set, touching only the postings that change
+static void doc_set_trigrams(uint32_t id, uint32_t *tris, uint32_t n)
+{
+    struct Doc *doc = &docs[id];
+    uint32_t i = 0, j = 0;
+    while (i < doc->count || j < n)
+    {
+        if (j == n || (i < doc->count && doc->trigrams[i] < tris[j]))
+            posting_remove(doc->trigrams[i++], id);
+        else if (i == doc->count || tris[j] < doc->trigrams[i])
+            posting_add(tris[j++], id);
+        else
+            i++, j++;
+    }
+    free(doc->trigrams);
+    doc->trigrams = tris;
+    doc->count = n;
+    doc->live = true;
+}
+
+// Merge new trigrams into the doc's set
+static void doc_add_trigrams(uint32_t id, const uint32_t *tris, uint32_t n)
+{
+    struct Doc *doc = &docs[id];
+    uint32_t *merged = malloc((doc->count + n) * sizeof(uint32_t));
+    if (merged == NULL && doc->count + n > 0)
+        return;
+
+    uint32_t i = 0, j = 0, k = 0;
+    while (i < doc->count || j < n)
+    {
+        if (j == n || (i < doc->count && doc->trigrams[i] < tris[j]))
+            merged[k++] = doc->trigrams[i++];
+        else if (i == doc->count || tris[j] < doc->trigrams[i])
+        {
+            posting_add(tris[j], id);
+            merged[k++] = tris[j++];
+        }
+        else
+            merged[k++] = doc->trigrams[i++], j++;
+    }
+    free(doc->trigrams);
+    doc->trigrams = merged;
+    doc->count = k;
+    doc->live = true;
+}
+
+static void doc_set_tail(uint32_t id, const unsigned char *content, size_t len, bool append)
+{
+    struct Doc *doc = &docs[id];
+    unsigned char buf[4];
+    size_t n = 0;
+    if (append)
+    {
+        memcpy(buf, doc->tail, doc->tail_len);
+        n = doc->tail_len;
+    }
+    for (size_t i = len > 2 ? len - 2 : 0; i < len; i++)
+        buf[n++] = content[i];
+    size_t keep = n > 2 ? 2 : n;
+    memcpy(doc->tail, buf + n - keep, keep);
+    doc->tail_len = keep;
+}
+
+static void doc_remove(uint32_t id)
+{
+    struct Doc *doc = &docs[id];
+    for (uint32_t i = 0; i < doc->count; i++)
+        posting_remove(doc->trigrams[i], id);
+    free(doc->trigrams);
+    doc->trigrams = NULL;
+    doc->count = 0;
+    doc->tail_len = 0;
+    doc->live = false;
+}
+
+// ---- journal ----
+
+// Returns the number of bytes written
+static size_t journal_write(FILE *file, char type, const struct Doc *doc, const uint32_t *tris, uint32_t n)
+{
+    if (file == NULL)
+        return 0;
+    uint16_t name_len = strlen(doc->name);
+    fputc(type, file);
+    fwrite(&name_len, sizeof(name_len), 1, file);
+    fwrite(doc->name, 1, name_len, file);
+    if (type != REC_DEL)
+    {
+        fputc(doc->tail_len, file);
+        fwrite(doc->tail, 1, 2, file);
+        fwrite(&n, sizeof(n), 1, file);
+        fwrite(tris, sizeof(uint32_t), n, file);
+    }
+    fflush(file);
+    return 1 + sizeof(name_len) + name_len + (type != REC_DEL ? 3 + sizeof(n) + n * sizeof(uint32_t) : 0);
+}
+
+static int journal_replay(FILE *file)
+{
+    int type;
+    while ((type = fgetc(file)) != EOF)
+    {
+        uint16_t name_len;
+        char name[NAME_LEN];
+        if (fread(&name_len, sizeof(name_len), 1, file) != 1 || name_len >= NAME_LEN ||
+            fread(name, 1, name_len, file) != name_len)
+            return -1;
+        name[name_len] = '\0';
+
+        int32_t id = doc_get(name);
+        if (id < 0)
+            return -1;
+        if (type == REC_DEL)
+        {
+            doc_remove(id);
+            continue;
+        }
+
+        unsigned char tail_len, tail[2];
+        uint32_t n;
+        if ((tail_len = fgetc(file)) > 2 || fread(tail, 1, 2, file) != 2 || fread(&n, sizeof(n), 1, file) != 1)
+            return -1;
+        uint32_t *tris = malloc((n ? n : 1) * sizeof(uint32_t));
+        if (tris == NULL || fread(tris, sizeof(uint32_t), n, file) != n)
+        {
+            free(tris);
+            return -1;
+        }
+
+        if (type == REC_SET)
+            doc_set_trigrams(id, tris, n);
+        else
+        {
+            doc_add_trigrams(id, tris, n);
+            free(tris);
+        }
+        docs[id].tail_len = tail_len;
+        memcpy(docs[id].tail, tail, 2);
+    }
+    return 0;
+}
+
+// Rewrite the journal as one SET record per live file and reopen it for appending.
+// Caller holds index_lock for writing
+static int journal_compact(void)
+{
+    if (journal)
+    {
+        fclose(journal);
+        journal = NULL;
+    }
+
+    char tmp_path[520];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", journal_path);
+    FILE *snapshot = fopen(tmp_path, "wb");
+    if (snapshot == NULL)
+    {
+        perror("Failed to write search index");
+        return -1;
+    }
+    size_t size = 0;
+    for (uint32_t id = 0; id < doc_count; id++)
+    {
+        if (docs[id].live)
+            size += journal_write(snapshot, REC_SET, &docs[id], docs[id].trigrams, docs[id].count);
+    }
+    fclose(snapshot);
+    if (rename(tmp_path, journal_path) < 0)
+    {
+        perror("Failed to replace search index");
+        return -1;
+    }
+
+    journal = fopen(journal_path, "ab");
+    if (journal == NULL)
+    {
+        perror("Failed to open search index");
+        return -1;
+    }
+    journal_size = snapshot_size = size;
+    return 0;
+}
+
+// Copy the file at `path` to the end of `dst`; returns the bytes copied or -1
+static long append_file(FILE *dst, const char *path)
+{
+    FILE *src = fopen(path, "rb");
+    if (src == NULL)
+        return -1;
+    char buf[64 * 1024];
+    long total = 0;
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), src)) > 0)
+    {
+        if (fwrite(buf, 1, n, dst) != n)
+        {
+            total = -1;
+            break;
+        }
+        total += n;
+    }
+    if (ferror(src))
+        total = -1;
+    fclose(src);
+    return total;
+}
+
+// Compactor thread. It copies the live docs and points the journal at delta_path under the
+// read lock (writers wait for the copy only, searches go on), writes the snapshot without any
+// lock, then takes the write lock just to append the delta and swap the files. A crash in
+// between leaves the old journal plus the delta, which search_index_open replays in order
+static void *compact_loop(void *arg)
+{
+    (void)arg;
+    while (1)
+    {
+        pthread_mutex_lock(&compact_lock);
+        while (!compact_wanted)
+            pthread_cond_wait(&compact_cond, &compact_lock);
+        compact_wanted = false;
+        pthread_mutex_unlock(&compact_lock);
+
+        pthread_rwlock_rdlock(&index_lock);
+        size_t before = journal_size;
+        uint32_t count = 0;
+        struct Doc *copy = malloc((doc_count ? doc_count : 1) * sizeof(struct Doc));
+        bool ok = copy != NULL;
+        for (uint32_t id = 0; ok && id < doc_count; id++)
+        {
+            if (!docs[id].live)
+                continue;
+            copy[count] = docs[id];
+            copy[count].trigrams = malloc((docs[id].count ? docs[id].count : 1) * sizeof(uint32_t));
+            if ((ok = copy[count].trigrams != NULL))
+                memcpy(copy[count++].trigrams, docs[id].trigrams, docs[id].count * sizeof(uint32_t));
+        }
+        // 只有持 write lock 的人會寫 journal，所以 read lock 下換掉它是安全的
+        FILE *delta = ok ? fopen(delta_path, "wb") : NULL;
+        if (delta)
+        {
+            fclose(journal);
+            journal = delta;
+            journal_size = 0;
+        }
+        pthread_rwlock_unlock(&index_lock);
+
+        char tmp_path[520];
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", journal_path);
+        FILE *snapshot = delta ? fopen(tmp_path, "wb") : NULL;
+        size_t size = 0;
+        for (uint32_t c = 0; snapshot && c < count; c++)
+            size += journal_write(snapshot, REC_SET, &copy[c], copy[c].trigrams, copy[c].count);
+        for (uint32_t c = 0; c < count; c++)
+            free(copy[c].trigrams);
+        free(copy);
+
+        pthread_rwlock_wrlock(&index_lock);
+        if (delta == NULL)
+        {
+            perror("Failed to start search index compaction");
+            compacting = false;
+            pthread_rwlock_unlock(&index_lock);
+            continue;
+        }
+
+        long delta_bytes = snapshot ? append_file(snapshot, delta_path) : -1;
+        bool replaced = false;
+        if (snapshot && fclose(snapshot) == 0 && delta_bytes >= 0)
+            replaced = rename(tmp_path, journal_path) == 0;
+        if (!replaced)
+        {
+            // 快照失敗，把 delta 接回原本的 journal
+            perror("Failed to write search index");
+            unlink(tmp_path);
+            size = before;
+        }
+
+        FILE *reopened = fopen(journal_path, "ab");
+        if (reopened && (replaced || (delta_bytes = append_file(reopened, delta_path)) >= 0))
+        {
+            fclose(journal);
+            journal = reopened;
+            unlink(delta_path);
+            journal_size = size + delta_bytes;
+            if (replaced)
+                snapshot_size = size;
+            compacting = false;
+            if (replaced)
+                printf("Search index journal compacted: %lu -> %lu bytes\n", (unsigned long)(before + delta_bytes), (unsigned long)journal_size);
+        }
+        else
+        {
+            // 繼續寫 delta，不再壓縮 (delta 只有在 rename 之後才能清掉)；重啟時會一起重播
+            perror("Failed to reopen search index");
+            if (reopened)
+                fclose(reopened);
+        }
+        pthread_rwlock_unlock(&index_lock);
+    }
+    return NULL;
+}
+
+// Record a journal write; once the journal is SEARCH_INDEX_COMPACT_RATIO times the last
+// snapshot (and at least SEARCH_INDEX_COMPACT_MIN) wake the compactor thread, so overwrites
+// cannot grow it forever. Caller holds index_lock for writing
+static void journal_grew(size_t bytes)
+{
+    journal_size += bytes;
+    size_t limit = snapshot_size * SEARCH_INDEX_COMPACT_RATIO;
+    if (limit < SEARCH_INDEX_COMPACT_MIN)
+        limit = SEARCH_INDEX_COMPACT_MIN;
+    if (journal == NULL || compacting || journal_size <= limit)
+        return;
+
+    compacting = true;
+    pthread_mutex_lock(&compact_lock);
+    compact_wanted = true;
+    pthread_cond_signal(&compact_cond);
+    pthread_mutex_unlock(&compact_lock);
+}
+
+int search_index_open(const char *dir)
+{
+    snprintf(journal_path, sizeof(journal_path), "%s/%s", dir, SEARCH_INDEX_FILE);
+    snprintf(delta_path, sizeof(delta_path), "%s.delta", journal_path);
+
+    // 上次壓縮中斷的話，delta 裡是換檔前還沒接上的紀錄，接在 journal 後面重播。
+    // 紀錄重播兩次結果一樣，所以 rename 之後、刪掉 delta 之前中斷也沒關係
+    pthread_rwlock_wrlock(&index_lock);
+    const char *paths[] = {journal_path, delta_path};
+    for (int p = 0; p < 2; p++)
+    {
+        FILE *file = fopen(paths[p], "rb");
+        if (file)
+        {
+            if (journal_replay(file) < 0)
+                fprintf(stderr, "Search index journal %s is truncated, keeping what was read\n", paths[p]);
+            fclose(file);
+        }
+    }
+
+    // 重寫成只有 SET 紀錄的快照
+    int result = journal_compact();
+    if (result == 0)
+        unlink(delta_path);
+    pthread_rwlock_unlock(&index_lock);
+    if (result < 0)
+        return -1;
+
+    pthread_t thread_id;
+    if (pthread_create(&thread_id, NULL, compact_loop, NULL) != 0)
+    {
+        perror("Failed to start search index compactor");
+        return -1;
+    }
+    pthread_detach(thread_id);
+
+    uint32_t live = 0;
+    for (uint32_t id = 0; id < doc_count; id++)
+        live += docs[id].live;
+    printf("Search index: %u files, %lu trigrams\n", live, (unsigned long)posting_used);
+    return 0;
+}
+
+void search_index_set(const char *filename, const char *content, size_t len)
+{
+    uint32_t *tris;
+    uint32_t n = extract_trigrams((const unsigned char *)content, len, &tris);
+
+    pthread_rwlock_wrlock(&index_lock);
+    int32_t id = doc_get(filename);
+    if (id >= 0)
+    {
+        doc_set_trigrams(id, tris, n);
+        doc_set_tail(id, (const unsigned char *)content, len, false);
+        journal_grew(journal_write(journal, REC_SET, &docs[id], tris, n));
+    }
+    else
+        free(tris);
+    pthread_rwlock_unlock(&index_lock);
+}
+
+void search_index_append(const char *filename, const char *content, size_t len)
+{
+    pthread_rwlock_wrlock(&index_lock);
+    int32_t id = doc_get(filename);
+    if (id < 0 || len == 0)
+    {
+        pthread_rwlock_unlock(&index_lock);
+        return;
+    }
+
+    // 前一次內容的最後兩個 byte 接上新內容，跨邊界的 trigram 才不會漏掉
+    unsigned char *joined = malloc(len + 2);
+    if (joined == NULL)
+    {
+        pthread_rwlock_unlock(&index_lock);
+        return;
+    }
+    struct Doc *doc = &docs[id];
+    memcpy(joined, doc->tail, doc->tail_len);
+    memcpy(joined + doc->tail_len, content, len);
+
+    uint32_t *tris;
+    uint32_t n = extract_trigrams(joined, doc->tail_len + len, &tris);
+    free(joined);
+
+    doc_add_trigrams(id, tris, n);
+    doc_set_tail(id, (const unsigned char *)content, len, true);
+    journal_grew(journal_write(journal, REC_ADD, &docs[id], tris, n));
+    free(tris);
+    pthread_rwlock_unlock(&index_lock);
+}
+
+void search_index_remove(const char *filename)
+{
+    pthread_rwlock_wrlock(&index_lock);
+    int32_t id = doc_find(filename);
+    if (id >= 0 && docs[id].live)
+    {
+        doc_remove(id);
+        journal_grew(journal_write(journal, REC_DEL, &docs[id], NULL, 0));
+    }
+    pthread_rwlock_unlock(&index_lock);
+}
+
+static int compare_postings(const void *a, const void *b)
+{
+    const struct Posting *x = *(struct Posting *const *)a, *y = *(struct Posting *const *)b;
+    return x->count < y->count ? -1 : x->count > y->count;
+}
+
+int search_index_query(const char *query, void (*found)(const char *filename, void *arg), void *arg)
+{
+    uint32_t *tris;
+    uint32_t n = extract_trigrams((const unsigned char *)query, strlen(query), &tris);
+    int matches = 0;
+
+    pthread_rwlock_rdlock(&index_lock);
+    if (n == 0)
+    {
+        // 少於 3 個字元沒有 trigram 可查，呼叫端應先擋掉
+        pthread_rwlock_unlock(&index_lock);
+        return 0;
+    }
+
+    struct Posting **lists = malloc(n * sizeof(struct Posting *));
+    bool missing = lists == NULL;
+    for (uint32_t i = 0; i < n && !missing; i++)
+    {
+        lists[i] = posting_slot(tris[i], false);
+        missing = lists[i] == NULL || lists[i]->count == 0;
+    }
+
+    if (!missing)
+    {
+        // Intersect starting from the shortest posting list
+        qsort(lists, n, sizeof(struct Posting *), compare_postings);
+        for (uint32_t k = 0; k < lists[0]->count; k++)
+        {
+            uint32_t doc = lists[0]->docs[k];
+            bool all = true;
+            for (uint32_t i = 1; i < n && all; i++)
+            {
+                size_t pos = lower_bound(lists[i]->docs, lists[i]->count, doc);
+                all = pos < lists[i]->count && lists[i]->docs[pos] == doc;
+            }
+            if (all)
+            {
+                found(docs[doc].name, arg);
+                matches++;
+            }
+        }
+    }
+    pthread_rwlock_unlock(&index_lock);
+
+    free(lists);
+    free(tris);
+    return matches;
+}
@@ -0,0 +1,29 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SEARCH_INDEX_FILE ".search.idx"
+#define SEARCH_INDEX_COMPACT_MIN (1024 * 1024) // journal size below which it is never compacted
+#define SEARCH_INDEX_COMPACT_RATIO 2           // compact when the journal is this times the last snapshot
+#define SEARCH_MIN_QUERY 3                     // shorter queries have no trigram to look up
+
+// Load the index journal from `dir` and compact it; later updates are appended to it and a
+// background thread compacts the journal again whenever it grows past the limits above
+int search_index_open(const char *dir);
+
+// Replace the indexed content of `filename` (create / overwrite)
+void search_index_set(const char *filename, const char *content, size_t len);
+
+// Index `len` bytes appended to `filename`; only trigrams not yet present are added
+void search_index_append(const char *filename, const char *content, size_t len);
+
+void search_index_remove(const char *filename);
+
+// Files that may contain `query` (every trigram of it matches); callers confirm the match.
+// Calls `found` for each candidate, returns the number of candidates (none for a query
+// shorter than SEARCH_MIN_QUERY)
+int search_index_query(const char *query, void (*found)(const char *filename, void *arg), void *arg);
+
+#endif
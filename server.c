@@ -1,16 +1,29 @@
+#define _GNU_SOURCE // pthread_setaffinity_np, CPU_SET
 #include "includes.h"
 #include <sys/stat.h>
 #include <pthread.h>
 #include <limits.h>
 #include <dirent.h>
 #include <time.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include "fd_cache.h"
+#include "uring_io.h"
+#include "rate_limit.h"
+#include "replication.h"
+#include "search_index.h"
+#include "watch.h"
+#include "chunk_store.h"
+#include <signal.h>
 
 #define MAX_CLIENTS 15
+#define MAX_ACCEPTORS 64
 #define MAX_FILENAME 256
 #define MAX_FILES_NUM 100
 #define MAX_GROUPS 5
 #define FILE_DIR "./file/"
 #define PERMISSION_LEN 6
+#define ADMIN_GROUP "admin" // names/export/import/drop/thaw，給 rebalance 工具用
 
 // Capability Structure
 struct Capability
@@ -23,11 +36,13 @@ struct Capability
     char permissions[7]; // rwrwrw : (owner, group, others)
     size_t size;
     bool isModified;
+    bool exported; // frozen by export until drop / thaw
 };
 
 // File Management Globals
-struct Capability capabilities[100]; // 檔案清單
-int file_count = 0;
+struct Capability capabilities[100]; // 檔案清單；刪掉的檔案留下空的 slot (filename 為空字串)
+int file_count = 0;                  // 用過的 slot 數，含中間空出來的
+char storage_dir[MAX_FILENAME] = FILE_DIR; // --dir 可以改掉，方便同一台機器跑多個 server
 
 // 格式化
 void format_response(Response *res, const char *status, const char *content)
@@ -49,9 +64,9 @@ void format_response(Response *res, const char *status, const char *content)
 void create_storage_dir()
 {
     struct stat st = {0};
-    if (stat(FILE_DIR, &st) == -1)
+    if (stat(storage_dir, &st) == -1)
     {
-        mkdir(FILE_DIR, 0755);
+        mkdir(storage_dir, 0755);
     }
 }
 
@@ -94,13 +109,212 @@ bool is_valid_permissions(const char *permissions)
     return true;
 }
 
+// Read up to `len` bytes starting at `offset`, retrying short reads
+ssize_t pread_full(int fd, char *buf, size_t len, off_t offset)
+{
+    size_t total = 0;
+    while (total < len)
+    {
+        ssize_t n = pread(fd, buf + total, len - total, offset + total);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (n == 0)
+            break;
+        total += n;
+    }
+    return total;
+}
+
+// Write all `len` bytes starting at `offset`
+ssize_t pwrite_full(int fd, const char *buf, size_t len, off_t offset)
+{
+    size_t total = 0;
+    while (total < len)
+    {
+        ssize_t n = pwrite(fd, buf + total, len - total, offset + total);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        total += n;
+    }
+    return total;
+}
+
+// Receive exactly `len` bytes
+ssize_t recv_full(int fd, char *buf, size_t len)
+{
+    size_t total = 0;
+    while (total < len)
+    {
+        ssize_t n = recv(fd, buf + total, len - total, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        total += n;
+    }
+    return total;
+}
+
+// Get the fd of capabilities[i], opening it with an io_uring OPENAT on a cache miss
+int uring_acquire(int i, const char *filepath, FdHandle *handle)
+{
+    if (fd_cache_lookup(i, handle) == 0)
+        return 0;
+
+    UringReq req = {0};
+    req.op = URING_OPENAT;
+    req.path = filepath;
+    req.flags = O_RDWR | O_CLOEXEC;
+    int fd = uring_io_run(&req);
+    if (fd < 0)
+    {
+        errno = -fd;
+        return -1;
+    }
+    fd_cache_install(i, fd, false, handle);
+    return 0;
+}
+
+// Read through io_uring, blocking the connection thread until the read completes
+ssize_t uring_pread(int fd, char *buf, size_t len, off_t offset)
+{
+    UringReq req = {0};
+    req.op = URING_READ;
+    req.fd = fd;
+    req.buf = buf;
+    req.len = len;
+    req.offset = offset;
+    int n = uring_io_run(&req);
+    if (n < 0)
+    {
+        errno = -n;
+        return -1;
+    }
+    return n;
+}
+
+// Write all of `len` bytes through io_uring; a short write is resubmitted like pwrite_full does.
+// Like the threaded path this does not fdatasync each write
+int uring_pwrite_full(int fd, const char *buf, size_t len, off_t offset)
+{
+    while (len > 0)
+    {
+        UringReq req = {0};
+        req.op = URING_WRITE;
+        req.fd = fd;
+        req.buf = (void *)buf;
+        req.len = len;
+        req.offset = offset;
+
+        int n = uring_io_run(&req);
+        if (n == -EINTR || n == -EAGAIN)
+            continue;
+        if (n <= 0)
+        {
+            errno = n < 0 ? -n : EIO;
+            return -1;
+        }
+        buf += n;
+        offset += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// 檔案內容的存取：一般模式透過 fd 快取讀寫整個檔案，--chunked 模式讀寫 chunk manifest
+
+// Create (or truncate) the file of capabilities[i]
+int storage_create(int i, const char *filepath)
+{
+    if (chunk_store_enabled())
+        return chunk_file_create(filepath);
+
+    // 建檔的同時把 fd 放進快取，之後的 read/write 不用再 open
+    FdHandle handle;
+    if (fd_cache_acquire(i, filepath, true, &handle) < 0)
+        return -1;
+    fd_cache_release(&handle);
+    return 0;
+}
+
+ssize_t storage_read(int i, const char *filepath, char *buf, size_t len, off_t offset)
+{
+    if (chunk_store_enabled())
+        return chunk_file_read(filepath, buf, len, offset);
+
+    FdHandle handle;
+    if (uring_io_enabled())
+    {
+        if (uring_acquire(i, filepath, &handle) < 0)
+            return -1;
+        ssize_t n = uring_pread(handle.fd, buf, len, offset);
+        fd_cache_release(&handle);
+        return n;
+    }
+
+    if (fd_cache_acquire(i, filepath, false, &handle) < 0)
+        return -1;
+    ssize_t n = pread_full(handle.fd, buf, len, offset);
+    fd_cache_release(&handle);
+    return n;
+}
+
+// Overwrite or append; *new_size is the file size afterwards
+bool storage_write(int i, const char *filepath, const char *content, size_t len, bool overwrite, size_t *new_size)
+{
+    if (chunk_store_enabled())
+        return chunk_file_write(filepath, content, len, !overwrite, new_size) == 0;
+
+    FdHandle handle;
+    if (fd_cache_acquire(i, filepath, false, &handle) < 0)
+        return false;
+    struct stat st;
+    bool ok;
+    if (overwrite)
+        ok = ftruncate(handle.fd, 0) == 0 && pwrite_full(handle.fd, content, len, 0) >= 0;
+    else
+        ok = fstat(handle.fd, &st) == 0 && pwrite_full(handle.fd, content, len, st.st_size) >= 0;
+    if (ok && fstat(handle.fd, &st) == 0)
+        *new_size = st.st_size;
+    fd_cache_release(&handle);
+    return ok;
+}
+
+void storage_remove(int i, const char *filepath)
+{
+    fd_cache_invalidate(i);
+    if (chunk_store_enabled())
+        chunk_file_remove(filepath);
+    else
+        unlink(filepath);
+}
+
 bool file_exists(const char *filename)
 {
     char filepath[MAX_FILENAME];
-    snprintf(filepath, sizeof(filepath), "%s%s", FILE_DIR, filename);
+    snprintf(filepath, sizeof(filepath), "%s%s", storage_dir, filename);
     return access(filepath, F_OK) == 0;
 }
 
+// Index for a new file: the first freed slot, else the end of the table; -1 when full
+int free_slot(void)
+{
+    for (int i = 0; i < file_count; i++)
+    {
+        if (capabilities[i].filename[0] == '\0')
+            return i;
+    }
+    return file_count < MAX_FILES_NUM ? file_count : -1;
+}
+
 // Add log entry (placeholder)
 void log_add(const char *username, const char *group, const char *action, const char *filename, size_t size, const char *status, const char *permissions, const char *last_modified)
 {
@@ -113,6 +327,32 @@ void log_add(const char *username, const char *group, const char *action, const
     printf("[LOG] User: %s, Group: %s, Action: %s, File: %s, %lu, Status: %s, %s, %s\n", username, group, action, filename, size, status, formatted_permissions, last_modified);
 }
 
+// owner / group / others 的讀取規則，read / search / watch 共用
+bool can_read(const struct Capability *cap, struct User client)
+{
+    return cap->permissions[4] == 'r' ||
+           (!strcmp(cap->group, client.group) && cap->permissions[2] == 'r') ||
+           !strcmp(cap->owner, client.name);
+}
+
+bool watcher_can_read(struct User user, void *arg)
+{
+    return can_read(arg, user);
+}
+
+// Push a committed change of capabilities[i] to the watchers allowed to read it
+void notify_watchers(int i, const char *op, const char *writer)
+{
+    WatchEvent event;
+    memset(&event, 0, sizeof(event));
+    snprintf(event.op, sizeof(event.op), "%s", op);
+    snprintf(event.filename, sizeof(event.filename), "%s", capabilities[i].filename);
+    event.size = capabilities[i].size;
+    snprintf(event.last_modified, sizeof(event.last_modified), "%s", capabilities[i].last_modified);
+    snprintf(event.writer, sizeof(event.writer), "%s", writer);
+    watch_notify(&event, watcher_can_read, &capabilities[i]);
+}
+
 // Create a file
 void create_file(int client_socket, struct User client, const char *filename, const char *permissions)
 {
@@ -128,8 +368,18 @@ void create_file(int client_socket, struct User client, const char *filename, co
         }
     }
 
+    // 開頭是 . 的名字留給 server 自己的檔案 (例如 search index)
+    if (filename[0] == '.')
+    {
+        Response res;
+        format_response(&res, "Invalid filename", "");
+        send(client_socket, &res, sizeof(res), 0);
+        return;
+    }
+
     // Check if file limit is reached
-    if (file_count >= MAX_FILES_NUM)
+    int i = free_slot();
+    if (i < 0)
     {
         Response res;
         format_response(&res, "File limit reached", "");
@@ -139,17 +389,16 @@ void create_file(int client_socket, struct User client, const char *filename, co
 
     // Ensure the storage directory exists
     struct stat st;
-    if (stat(FILE_DIR, &st) == -1)
+    if (stat(storage_dir, &st) == -1)
     {
-        mkdir(FILE_DIR, 0700);
+        mkdir(storage_dir, 0700);
     }
 
     // Create file
     char filepath[512];
-    snprintf(filepath, sizeof(filepath), "%s/%s", FILE_DIR, filename);
+    snprintf(filepath, sizeof(filepath), "%s/%s", storage_dir, filename);
 
-    FILE *file = fopen(filepath, "w");
-    if (!file)
+    if (storage_create(i, filepath) < 0)
     {
         perror("Failed to create file");
 
@@ -158,25 +407,28 @@ void create_file(int client_socket, struct User client, const char *filename, co
         send(client_socket, &res, sizeof(res), 0);
         return;
     }
-    fclose(file);
 
     // Update file list
-    strncpy(capabilities[file_count].filename, filename, MAX_FILENAME - 1);
-    strncpy(capabilities[file_count].owner, client.name, 49);
-    strncpy(capabilities[file_count].group, client.group, 49);
-    strncpy(capabilities[file_count].permissions, permissions, 5);
+    strncpy(capabilities[i].filename, filename, MAX_FILENAME - 1);
+    strncpy(capabilities[i].owner, client.name, 49);
+    strncpy(capabilities[i].group, client.group, 49);
+    strncpy(capabilities[i].permissions, permissions, 5);
 
-    capabilities[file_count].size = 0;
-    capabilities[file_count].isModified = false;
+    capabilities[i].size = 0;
+    capabilities[i].isModified = false;
 
     // Set last modified time
     time_t now = time(NULL);
     struct tm *tm_info = localtime(&now);
-    strftime(capabilities[file_count].last_modified, sizeof(capabilities[file_count].last_modified), "%Y/%m/%d %H:%M", tm_info);
+    strftime(capabilities[i].last_modified, sizeof(capabilities[i].last_modified), "%Y/%m/%d %H:%M", tm_info);
 
-    log_add(client.name, client.group, "create", filename, capabilities[file_count].size, "success", permissions, capabilities[file_count].last_modified);
+    log_add(client.name, client.group, "create", filename, capabilities[i].size, "success", permissions, capabilities[i].last_modified);
+    repl_log(REPL_CREATE, filename, capabilities[i].owner, capabilities[i].group, capabilities[i].permissions, NULL, capabilities[i].last_modified, NULL, 0, 0);
+    search_index_set(filename, "", 0); // 清掉同名舊檔留在 index 裡的內容
 
-    file_count++;
+    if (i == file_count)
+        file_count++;
+    notify_watchers(i, "create", client.name);
 
     Response res;
     format_response(&res, "File created successfully", "");
@@ -191,9 +443,7 @@ void read_file(int client_socket, struct User client, const char *filename)
         if (strcmp(capabilities[i].filename, filename) == 0)
         {
             // Check permissions
-            if ((capabilities[i].permissions[4] == 'r') ||
-                (!strcmp(capabilities[i].group, client.group) && capabilities[i].permissions[2] == 'r') ||
-                (!strcmp(capabilities[i].owner, client.name)))
+            if (can_read(&capabilities[i], client))
             {
 
                 if (capabilities[i].isModified)
@@ -204,12 +454,24 @@ void read_file(int client_socket, struct User client, const char *filename)
                     return;
                 }
 
+                // 讀取最多 CONTENT_SIZE - 1 bytes，照此扣 bytes/sec 額度
+                size_t cost = capabilities[i].size < CONTENT_SIZE - 1 ? capabilities[i].size : CONTENT_SIZE - 1;
+                if (!rate_limit_allow_bytes(client.name, client.group, cost))
+                {
+                    Response res;
+                    format_response(&res, "Rate limited", "");
+                    send(client_socket, &res, sizeof(res), 0);
+                    log_add(client.name, client.group, "read", filename, capabilities[i].size, "rate limited", capabilities[i].permissions, capabilities[i].last_modified);
+                    return;
+                }
+
                 char filepath[512];
-                snprintf(filepath, sizeof(filepath), "%s/%s", FILE_DIR, filename);
+                snprintf(filepath, sizeof(filepath), "%s/%s", storage_dir, filename);
 
-                // 打開檔案進行讀取
-                FILE *file = fopen(filepath, "r");
-                if (!file)
+                char file_content[CONTENT_SIZE];
+                ssize_t read_size = storage_read(i, filepath, file_content, CONTENT_SIZE - 1, 0);
+
+                if (read_size < 0)
                 {
                     perror("Failed to open file");
                     Response res;
@@ -219,10 +481,7 @@ void read_file(int client_socket, struct User client, const char *filename)
                 }
                 else
                 {
-                    char file_content[CONTENT_SIZE];
-                    size_t read_size = fread(file_content, 1, CONTENT_SIZE - 1, file);
                     file_content[read_size] = '\0';
-                    fclose(file);
 
                     Response res;
                     format_response(&res, "File read successful", file_content);
@@ -250,6 +509,48 @@ void read_file(int client_socket, struct User client, const char *filename)
     }
 }
 
+// Finish a write: update the capability and answer the client.
+// `reserved` is the storage taken from the quota before writing; `new_size` is the size
+// on disk afterwards, also when the write failed part way
+void write_done(int client_socket, struct User client, int i, bool overwrite, bool ok, size_t new_size, long reserved,
+                const char *content, size_t content_len)
+{
+    Response res;
+
+    long actual = (long)new_size - (long)capabilities[i].size;
+    quota_release(capabilities[i].owner, capabilities[i].group, reserved - actual);
+    capabilities[i].size = new_size;
+
+    if (!ok)
+    {
+        format_response(&res, overwrite ? "Failed to overwrite file" : "Failed to append content", "");
+        send(client_socket, &res, sizeof(res), 0);
+        log_add(client.name, client.group, "write", capabilities[i].filename, capabilities[i].size, "failed", capabilities[i].permissions, capabilities[i].last_modified);
+        capabilities[i].isModified = false;
+        return;
+    }
+
+    // update last modified time
+    time_t now = time(NULL);
+    struct tm *tm_info = localtime(&now);
+    strftime(capabilities[i].last_modified, sizeof(capabilities[i].last_modified), "%Y/%m/%d %H:%M", tm_info);
+
+    repl_log(REPL_WRITE, capabilities[i].filename, capabilities[i].owner, capabilities[i].group, capabilities[i].permissions,
+             overwrite ? "o" : "a", capabilities[i].last_modified, content, content_len, capabilities[i].size);
+
+    // append 只需要把新內容的 trigram 加進去
+    if (overwrite)
+        search_index_set(capabilities[i].filename, content, content_len);
+    else
+        search_index_append(capabilities[i].filename, content, content_len);
+
+    format_response(&res, overwrite ? "File overwritten" : "Content appended", "");
+    send(client_socket, &res, sizeof(res), 0);
+    log_add(client.name, client.group, "write", capabilities[i].filename, capabilities[i].size, "success", capabilities[i].permissions, capabilities[i].last_modified);
+    capabilities[i].isModified = false;
+    notify_watchers(i, "write", client.name); // 解除 isModified 之後才通知，watcher 馬上 read 不會撞到
+}
+
 // Write to a file
 void write_file(int client_socket, struct User client, const char *filename, const char *write_mode)
 {
@@ -274,29 +575,45 @@ void write_file(int client_socket, struct User client, const char *filename, con
             {
 
                 char filepath[512];
-                snprintf(filepath, sizeof(filepath), "%s/%s", FILE_DIR, filename);
+                snprintf(filepath, sizeof(filepath), "%s/%s", storage_dir, filename);
 
-                FILE *file;
                 Response res;
+                bool use_uring = uring_io_enabled();
+                bool overwrite = !strcmp(write_mode, "o");
+
+                bool chunked = chunk_store_enabled();
 
-                file = fopen(filepath, "r");
-                if (file == NULL)
+                // 一次取得 fd，回顯內容、寫入、取大小都用同一個 fd (chunked 模式不用 fd)
+                FdHandle handle = {-1, -1};
+                int acquired = chunked ? 0 : use_uring ? uring_acquire(i, filepath, &handle) : fd_cache_acquire(i, filepath, false, &handle);
+                if (acquired < 0)
                 {
                     perror("Failed to open file");
                     format_response(&res, "Failed to get file content", "");
                     send(client_socket, &res, sizeof(res), 0);
                     log_add(client.name, client.group, "write", filename, capabilities[i].size, "failed", capabilities[i].permissions, capabilities[i].last_modified);
+                    capabilities[i].isModified = false;
+                    return;
+                }
+
+                char file_content[CONTENT_SIZE];
+                ssize_t file_size;
+                if (use_uring)
+                {
+                    file_size = uring_pread(handle.fd, file_content, CONTENT_SIZE - 1, 0);
+                }
+                else if (chunked)
+                {
+                    file_size = chunk_file_read(filepath, file_content, CONTENT_SIZE - 1, 0);
                 }
                 else
                 {
-                    char file_content[CONTENT_SIZE];
-                    size_t read_size = fread(file_content, 1, CONTENT_SIZE - 1, file);
-                    file_content[read_size] = '\0';
-                    fclose(file);
-
-                    format_response(&res, "Ready for writing the file", file_content);
-                    send(client_socket, &res, sizeof(res), 0);
+                    file_size = pread_full(handle.fd, file_content, CONTENT_SIZE - 1, 0);
                 }
+                file_content[file_size > 0 ? file_size : 0] = '\0';
+
+                format_response(&res, "Ready for writing the file", file_content);
+                send(client_socket, &res, sizeof(res), 0);
 
                 // 接收客戶端的內容
                 char content[CONTENT_SIZE];
@@ -307,59 +624,70 @@ void write_file(int client_socket, struct User client, const char *filename, con
                     format_response(&res, "Failed to receive content", "");
                     send(client_socket, &res, sizeof(res), 0);
                     log_add(client.name, client.group, "write", filename, capabilities[i].size, "failed", capabilities[i].permissions, capabilities[i].last_modified);
+                    fd_cache_release(&handle);
                     capabilities[i].isModified = false;
                     return;
                 }
                 content[read_size] = '\0';
+                size_t content_len = strlen(content);
+
+                if (!rate_limit_allow_bytes(client.name, client.group, content_len))
+                {
+                    format_response(&res, "Rate limited", "");
+                    send(client_socket, &res, sizeof(res), 0);
+                    log_add(client.name, client.group, "write", filename, capabilities[i].size, "rate limited", capabilities[i].permissions, capabilities[i].last_modified);
+                    fd_cache_release(&handle);
+                    capabilities[i].isModified = false;
+                    return;
+                }
 
-                if (!strcmp(write_mode, "o"))
+                // 檔案的空間算在 owner 與其 group 的 quota 上
+                long reserved = (long)(overwrite ? content_len : capabilities[i].size + content_len) - (long)capabilities[i].size;
+                if (!quota_reserve(capabilities[i].owner, capabilities[i].group, reserved))
                 {
-                    file = fopen(filepath, "w");
-                    if (file == NULL)
-                    {
-                        perror("Failed to open file for overwriting");
-                        format_response(&res, "Failed to overwrite file", "");
-                        send(client_socket, &res, sizeof(res), 0);
-                        log_add(client.name, client.group, "write", filename, capabilities[i].size, "failed", capabilities[i].permissions, capabilities[i].last_modified);
-                        capabilities[i].isModified = false;
-                        return;
-                    }
-
-                    fprintf(file, "%s", content);
-                    fclose(file);
-                    format_response(&res, "File overwritten", "");
+                    format_response(&res, "Quota exceeded", "");
+                    send(client_socket, &res, sizeof(res), 0);
+                    log_add(client.name, client.group, "write", filename, capabilities[i].size, "quota exceeded", capabilities[i].permissions, capabilities[i].last_modified);
+                    fd_cache_release(&handle);
+                    capabilities[i].isModified = false;
+                    return;
                 }
-                else
+
+                // 只寫有變動的 chunk
+                if (chunked)
                 {
-                    file = fopen(filepath, "a");
-                    if (file == NULL)
-                    {
-                        perror("Failed to open file for appending");
-                        format_response(&res, "Failed to append content", "");
-                        send(client_socket, &res, sizeof(res), 0);
-                        log_add(client.name, client.group, "write", filename, capabilities[i].size, "failed", capabilities[i].permissions, capabilities[i].last_modified);
-                        capabilities[i].isModified = false;
-                        return;
-                    }
-
-                    fprintf(file, "%s", content);
-                    fclose(file);
-                    format_response(&res, "Content appended", "");
+                    size_t new_size = capabilities[i].size; // 失敗時舊的 manifest 不變
+                    bool ok = chunk_file_write(filepath, content, content_len, !overwrite, &new_size) == 0;
+                    if (!ok)
+                        perror(overwrite ? "Failed to overwrite file" : "Failed to append content");
+                    write_done(client_socket, client, i, overwrite, ok, new_size, reserved, content, content_len);
+                    return;
                 }
 
                 struct stat st;
-                if (stat(filepath, &st) == 0)
-                    capabilities[i].size = st.st_size;
+                if (overwrite ? ftruncate(handle.fd, 0) < 0 : fstat(handle.fd, &st) < 0)
+                {
+                    perror(overwrite ? "Failed to open file for overwriting" : "Failed to open file for appending");
+                    write_done(client_socket, client, i, overwrite, false, capabilities[i].size, reserved, NULL, 0);
+                    fd_cache_release(&handle);
+                    return;
+                }
+                off_t offset = overwrite ? 0 : st.st_size;
+
+                // 回覆由這條連線的 thread 送出，回覆送出前不會讀下一個 request，順序也不會亂
+                bool ok = (use_uring ? uring_pwrite_full(handle.fd, content, content_len, offset)
+                                     : pwrite_full(handle.fd, content, content_len, offset)) >= 0;
+                if (!ok)
+                    perror(overwrite ? "Failed to overwrite file" : "Failed to append content");
+
+                size_t new_size = offset + content_len;
+                if (fstat(handle.fd, &st) == 0)
+                    new_size = st.st_size;
                 else
                     perror("Failed to get file size");
+                fd_cache_release(&handle);
 
-                // update last modified time
-                time_t now = time(NULL);
-                struct tm *tm_info = localtime(&now);
-                strftime(capabilities[i].last_modified, sizeof(capabilities[i].last_modified), "%Y/%m/%d %H:%M", tm_info);
-
-                send(client_socket, &res, sizeof(res), 0);
-                log_add(client.name, client.group, "write", filename, capabilities[i].size, "success", capabilities[i].permissions, capabilities[i].last_modified);
+                write_done(client_socket, client, i, overwrite, ok, new_size, reserved, content, content_len);
             }
             else
             {
@@ -367,8 +695,8 @@ void write_file(int client_socket, struct User client, const char *filename, con
                 format_response(&res, "Permission denied.", "");
                 send(client_socket, &res, sizeof(res), 0);
                 log_add(client.name, client.group, "write", filename, capabilities[i].size, "permission denied", capabilities[i].permissions, capabilities[i].last_modified);
+                capabilities[i].isModified = false;
             }
-            capabilities[i].isModified = false;
             return;
         }
     }
@@ -388,11 +716,13 @@ void change_mode(int client_socket, struct User client, const char *filename, co
             if (!strcmp(capabilities[i].owner, client.name))
             {
                 strncpy(capabilities[i].permissions, permissions, 5);
+                repl_log(REPL_MODE, filename, capabilities[i].owner, capabilities[i].group, capabilities[i].permissions, NULL, capabilities[i].last_modified, NULL, 0, capabilities[i].size);
 
                 Response res;
                 format_response(&res, "Permissions changed", "");
                 send(client_socket, &res, sizeof(res), 0);
                 log_add(client.name, client.group, "mode", filename, capabilities[i].size, "permissions changed", capabilities[i].permissions, capabilities[i].last_modified);
+                notify_watchers(i, "mode", client.name);
             }
             else
             {
@@ -410,10 +740,533 @@ void change_mode(int client_socket, struct User client, const char *filename, co
     send(client_socket, &res, sizeof(res), 0);
 }
 
+// List every file: permissions, owner, group, size, last modified, name
+void list_files(int client_socket)
+{
+    char listing[BUFFER_SIZE] = {0};
+    size_t used = 0;
+
+    for (int i = 0; i < file_count && used < sizeof(listing); i++)
+    {
+        if (capabilities[i].filename[0] == '\0')
+            continue;
+
+        char permissions[PERMISSION_LEN + 1] = {0};
+        strncpy(permissions, capabilities[i].permissions, PERMISSION_LEN);
+        fix_permissions_format(permissions);
+
+        used += snprintf(listing + used, sizeof(listing) - used, "%s %s %s %lu %s %s\n",
+                         permissions, capabilities[i].owner, capabilities[i].group,
+                         capabilities[i].size, capabilities[i].last_modified, capabilities[i].filename);
+    }
+
+    Response res;
+    format_response(&res, "SUCCESS", listing);
+    send(client_socket, &res, sizeof(res), 0);
+}
+
+// Free the slot of capabilities[i]. Other files keep their index: it is the fd cache key and
+// the `names` cursor, and other threads may be using it
+void remove_capability(int i)
+{
+    fd_cache_invalidate(i);
+    memset(&capabilities[i], 0, sizeof(capabilities[i]));
+    while (file_count > 0 && capabilities[file_count - 1].filename[0] == '\0')
+        file_count--;
+}
+
+// Apply a change shipped by the primary (standby only)
+bool repl_apply(const ReplRecord *record, const char *content)
+{
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s/%s", storage_dir, record->filename);
+
+    int i = 0;
+    while (i < file_count && strcmp(capabilities[i].filename, record->filename) != 0)
+        i++;
+
+    switch (record->op)
+    {
+    case REPL_CREATE:
+        if (i == file_count && (i = free_slot()) < 0)
+            return false;
+        if (storage_create(i, filepath) < 0)
+            return false;
+
+        // 重播時同名檔案直接重建
+        memset(&capabilities[i], 0, sizeof(capabilities[i]));
+        strncpy(capabilities[i].filename, record->filename, MAX_FILENAME - 1);
+        strncpy(capabilities[i].owner, record->owner, 49);
+        strncpy(capabilities[i].group, record->group, 49);
+        strncpy(capabilities[i].permissions, record->permissions, PERMISSION_LEN);
+        strncpy(capabilities[i].last_modified, record->last_modified, sizeof(capabilities[i].last_modified) - 1);
+        if (i == file_count)
+            file_count++;
+        search_index_set(record->filename, "", 0);
+        break;
+
+    case REPL_WRITE:
+    {
+        if (i == file_count)
+            return false;
+
+        bool overwrite = !strcmp(record->write_mode, "o");
+        size_t before = record->size - record->length; // append 之前 primary 上的大小
+        if (!overwrite && capabilities[i].size != before)
+        {
+            // 快照已經含有 (或含有一部分) 這次 append：已完整就略過，否則從 append 前的內容重寫
+            if (capabilities[i].size == record->size)
+                break;
+            if (capabilities[i].size < before)
+                return false;
+            char *rebuilt = malloc(record->size + 1);
+            if (rebuilt == NULL || storage_read(i, filepath, rebuilt, before, 0) != (ssize_t)before)
+            {
+                free(rebuilt);
+                return false;
+            }
+            memcpy(rebuilt + before, content, record->length);
+            rebuilt[record->size] = '\0';
+            ReplRecord whole = *record;
+            strcpy(whole.write_mode, "o");
+            whole.length = record->size;
+            bool ok = repl_apply(&whole, rebuilt);
+            free(rebuilt);
+            return ok;
+        }
+
+        capabilities[i].isModified = true;
+        size_t new_size = capabilities[i].size;
+        bool ok = storage_write(i, filepath, content, record->length, overwrite, &new_size);
+        capabilities[i].size = new_size;
+
+        strncpy(capabilities[i].last_modified, record->last_modified, sizeof(capabilities[i].last_modified) - 1);
+        capabilities[i].isModified = false;
+        if (!ok)
+            return false;
+        if (!strcmp(record->write_mode, "o"))
+            search_index_set(record->filename, content, record->length);
+        else
+            search_index_append(record->filename, content, record->length);
+        break;
+    }
+
+    case REPL_MODE:
+        if (i == file_count)
+            return false;
+        strncpy(capabilities[i].permissions, record->permissions, PERMISSION_LEN);
+        break;
+
+    case REPL_DROP:
+        if (i == file_count)
+            return false;
+        storage_remove(i, filepath);
+        search_index_remove(record->filename);
+        log_add(record->owner, record->group, "replicate drop", record->filename, capabilities[i].size, "success", capabilities[i].permissions, capabilities[i].last_modified);
+        remove_capability(i);
+        return true;
+
+    case REPL_RESET:
+        // 換了 primary 或落後太多：清掉所有檔案，接著的快照會重建
+        for (i = file_count - 1; i >= 0; i--)
+        {
+            if (capabilities[i].filename[0] == '\0')
+                continue;
+            snprintf(filepath, sizeof(filepath), "%s/%s", storage_dir, capabilities[i].filename);
+            storage_remove(i, filepath);
+            search_index_remove(capabilities[i].filename);
+            remove_capability(i);
+        }
+        return true;
+
+    default:
+        return false;
+    }
+
+    log_add(record->owner, record->group, "replicate", record->filename, capabilities[i].size, "success", capabilities[i].permissions, capabilities[i].last_modified);
+    // record 沒有寫入者，standby 上的事件以 owner 代替
+    notify_watchers(i, record->op == REPL_CREATE ? "create" : record->op == REPL_WRITE ? "write" : "mode", record->owner);
+    return true;
+}
+
+// Primary: send every file to a standby that needs a full resync
+bool repl_snapshot(repl_emit_fn emit, void *link)
+{
+    for (int i = 0; i < file_count; i++)
+    {
+        struct Capability cap = capabilities[i];
+        if (cap.filename[0] == '\0')
+            continue;
+        char filepath[512];
+        snprintf(filepath, sizeof(filepath), "%s/%s", storage_dir, cap.filename);
+
+        ReplRecord record;
+        repl_record_init(&record, REPL_CREATE, cap.filename, cap.owner, cap.group, cap.permissions, NULL, cap.last_modified, 0, 0);
+        if (!emit(link, &record, NULL))
+            return false;
+
+        // 正在寫的檔案可能讀到一半的內容，之後 log 裡的那筆 write 會把它補正
+        char *content = malloc(cap.size + 1);
+        if (content == NULL)
+            return false;
+        size_t got = 0;
+        while (got < cap.size)
+        {
+            ssize_t n = storage_read(i, filepath, content + got, cap.size - got, got);
+            if (n <= 0)
+                break;
+            got += n;
+        }
+
+        repl_record_init(&record, REPL_WRITE, cap.filename, cap.owner, cap.group, cap.permissions, "o", cap.last_modified, got, got);
+        bool sent = emit(link, &record, content);
+        free(content);
+        if (!sent)
+            return false;
+    }
+    return true;
+}
+
+bool is_admin(struct User client)
+{
+    return !strcmp(client.group, ADMIN_GROUP);
+}
+
+int find_capability(const char *filename)
+{
+    for (int i = 0; i < file_count; i++)
+    {
+        if (!strcmp(capabilities[i].filename, filename))
+            return i;
+    }
+    return -1;
+}
+
+// Admin: filenames from slot `start`, one per line, as many as fit in one response.
+// The first line is "next <slot>", the cursor for the following page
+void list_names(int client_socket, int start)
+{
+    char names[BUFFER_SIZE] = {0};
+    char page[BUFFER_SIZE] = {0};
+    size_t used = 0;
+
+    int i = start < 0 ? 0 : start;
+    for (; i < file_count; i++)
+    {
+        size_t len = strlen(capabilities[i].filename) + 1;
+        if (len == 1)
+            continue; // 空的 slot
+        if (used + len >= sizeof(page) - 16)
+            break;
+        used += snprintf(page + used, sizeof(page) - used, "%s\n", capabilities[i].filename);
+    }
+    int header = snprintf(names, sizeof(names), "next %d\n", i);
+    memcpy(names + header, page, used + 1); // page 留了 16 bytes 給 header
+
+    Response res;
+    format_response(&res, "SUCCESS", names);
+    send(client_socket, &res, sizeof(res), 0);
+}
+
+// Admin: send metadata, then the full content. The file stays frozen
+// ("File is modifying") until it is dropped or thawed
+void export_file(int client_socket, struct User client, const char *filename)
+{
+    Response res;
+    int i = find_capability(filename);
+    if (i < 0)
+    {
+        format_response(&res, "File not found", "");
+        send(client_socket, &res, sizeof(res), 0);
+        return;
+    }
+    if (capabilities[i].isModified)
+    {
+        format_response(&res, "File is modifying", "");
+        send(client_socket, &res, sizeof(res), 0);
+        return;
+    }
+    capabilities[i].isModified = true;
+    capabilities[i].exported = true;
+
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s/%s", storage_dir, filename);
+
+    off_t size = capabilities[i].size;
+
+    char permissions[PERMISSION_LEN + 1] = {0};
+    strncpy(permissions, capabilities[i].permissions, PERMISSION_LEN);
+    fix_permissions_format(permissions);
+
+    char meta[BUFFER_SIZE];
+    snprintf(meta, sizeof(meta), "%s %s %s %lu %s", capabilities[i].owner, capabilities[i].group,
+             permissions, (unsigned long)size, capabilities[i].last_modified);
+    format_response(&res, "SUCCESS", meta);
+    send(client_socket, &res, sizeof(res), 0);
+
+    char buf[CONTENT_SIZE];
+    off_t offset = 0;
+    while (offset < size)
+    {
+        size_t want = size - offset < (off_t)sizeof(buf) ? (size_t)(size - offset) : sizeof(buf);
+        ssize_t n = storage_read(i, filepath, buf, want, offset);
+        if (n <= 0)
+        {
+            memset(buf, 0, want); // 長度已經送出，補零讓對方能收完
+            n = want;
+        }
+        if (send(client_socket, buf, n, MSG_NOSIGNAL) < 0)
+            break;
+        offset += n;
+    }
+    log_add(client.name, client.group, "export", filename, size, "success", capabilities[i].permissions, capabilities[i].last_modified);
+}
+
+// Admin: create a file with the given metadata from `size` raw bytes sent after "Ready for import"
+void import_file(int client_socket, struct User client, const char *args)
+{
+    char filename[MAX_FILENAME], owner[50], group[50], permissions[PERMISSION_LEN + 1];
+    unsigned long size;
+    int consumed = 0;
+    Response res;
+
+    if (sscanf(args, "%255s %49s %49s %6s %lu %n", filename, owner, group, permissions, &size, &consumed) != 5 || consumed == 0 ||
+        !is_valid_permissions(permissions))
+    {
+        format_response(&res, "Invalid import format", "");
+        send(client_socket, &res, sizeof(res), 0);
+        return;
+    }
+    const char *last_modified = args + consumed;
+
+    if (find_capability(filename) >= 0)
+    {
+        format_response(&res, "File already exists", "");
+        send(client_socket, &res, sizeof(res), 0);
+        return;
+    }
+    if (free_slot() < 0)
+    {
+        format_response(&res, "File limit reached", "");
+        send(client_socket, &res, sizeof(res), 0);
+        return;
+    }
+
+    char *content = malloc(size + 1);
+    if (content == NULL)
+    {
+        format_response(&res, "Failed to import file", "");
+        send(client_socket, &res, sizeof(res), 0);
+        return;
+    }
+
+    format_response(&res, "Ready for import", "");
+    send(client_socket, &res, sizeof(res), 0);
+    if (recv_full(client_socket, content, size) < 0)
+    {
+        perror("Failed to receive import content");
+        free(content);
+        return;
+    }
+
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s/%s", storage_dir, filename);
+
+    int i = free_slot();
+    size_t written;
+    if (storage_create(i, filepath) < 0 || !storage_write(i, filepath, content, size, true, &written))
+    {
+        perror("Failed to write imported file");
+        storage_remove(i, filepath);
+        free(content);
+        format_response(&res, "Failed to import file", "");
+        send(client_socket, &res, sizeof(res), 0);
+        return;
+    }
+
+    memset(&capabilities[i], 0, sizeof(capabilities[i]));
+    strncpy(capabilities[i].filename, filename, MAX_FILENAME - 1);
+    strncpy(capabilities[i].owner, owner, 49);
+    strncpy(capabilities[i].group, group, 49);
+    strncpy(capabilities[i].permissions, permissions, 5);
+    strncpy(capabilities[i].last_modified, last_modified, sizeof(capabilities[i].last_modified) - 1);
+    capabilities[i].size = size;
+    if (i == file_count)
+        file_count++;
+    notify_watchers(i, "create", owner);
+
+    quota_release(owner, group, -(long)size);
+    repl_log(REPL_CREATE, filename, owner, group, capabilities[i].permissions, NULL, capabilities[i].last_modified, NULL, 0, 0);
+    repl_log(REPL_WRITE, filename, owner, group, capabilities[i].permissions, "o", capabilities[i].last_modified, content, size, size);
+    search_index_set(filename, content, size);
+    free(content);
+
+    log_add(client.name, client.group, "import", filename, size, "success", capabilities[i].permissions, capabilities[i].last_modified);
+    format_response(&res, "File imported", "");
+    send(client_socket, &res, sizeof(res), 0);
+}
+
+// Admin: remove a file after it moved to another shard. Only a file frozen by export can be
+// dropped, so no write is in progress on it
+void drop_file(int client_socket, struct User client, const char *filename)
+{
+    Response res;
+    int i = find_capability(filename);
+    if (i < 0)
+    {
+        format_response(&res, "File not found", "");
+        send(client_socket, &res, sizeof(res), 0);
+        return;
+    }
+    if (!capabilities[i].exported)
+    {
+        format_response(&res, "File is not exported", "");
+        send(client_socket, &res, sizeof(res), 0);
+        return;
+    }
+
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s/%s", storage_dir, filename);
+    storage_remove(i, filepath);
+    search_index_remove(filename);
+
+    quota_release(capabilities[i].owner, capabilities[i].group, capabilities[i].size);
+    repl_log(REPL_DROP, filename, capabilities[i].owner, capabilities[i].group, capabilities[i].permissions, NULL, capabilities[i].last_modified, NULL, 0, 0);
+    log_add(client.name, client.group, "drop", filename, capabilities[i].size, "success", capabilities[i].permissions, capabilities[i].last_modified);
+    remove_capability(i);
+
+    format_response(&res, "File dropped", "");
+    send(client_socket, &res, sizeof(res), 0);
+}
+
+// Admin: undo the freeze of an export that was not followed by a drop
+void thaw_file(int client_socket, const char *filename)
+{
+    Response res;
+    int i = find_capability(filename);
+    if (i < 0)
+    {
+        format_response(&res, "File not found", "");
+        send(client_socket, &res, sizeof(res), 0);
+        return;
+    }
+    if (!capabilities[i].exported)
+    {
+        format_response(&res, "File is not exported", ""); // isModified 可能是正在寫入，不能清掉
+        send(client_socket, &res, sizeof(res), 0);
+        return;
+    }
+    capabilities[i].exported = false;
+    capabilities[i].isModified = false;
+    format_response(&res, "File thawed", "");
+    send(client_socket, &res, sizeof(res), 0);
+}
+
+// Candidate filenames from the index, copied out before the index lock is released
+struct SearchCandidates
+{
+    char (*names)[MAX_FILENAME];
+    int count;
+    int capacity;
+};
+
+void collect_candidate(const char *filename, void *arg)
+{
+    struct SearchCandidates *candidates = arg;
+    if (candidates->count == candidates->capacity)
+    {
+        int capacity = candidates->capacity ? candidates->capacity * 2 : 64;
+        void *names = realloc(candidates->names, capacity * sizeof(*candidates->names));
+        if (names == NULL)
+            return;
+        candidates->names = names;
+        candidates->capacity = capacity;
+    }
+    snprintf(candidates->names[candidates->count++], MAX_FILENAME, "%s", filename);
+}
+
+// Scan capabilities[i] for `query`, a block at a time with an overlap so matches across blocks are found
+bool file_contains(int i, const char *query)
+{
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s/%s", storage_dir, capabilities[i].filename);
+
+    size_t query_len = strlen(query);
+    size_t block = 64 * 1024;
+    char *buf = malloc(block + query_len);
+    bool found = false;
+    size_t carry = 0;
+    off_t offset = 0;
+    while (buf && !found)
+    {
+        ssize_t n = storage_read(i, filepath, buf + carry, block, offset);
+        if (n <= 0)
+            break;
+        offset += n;
+        n += carry;
+        found = memmem(buf, n, query, query_len) != NULL;
+
+        carry = query_len - 1 < (size_t)n ? query_len - 1 : (size_t)n;
+        memmove(buf, buf + n - carry, carry);
+    }
+    free(buf);
+    return found;
+}
+
+// Filenames containing `query` that the client may read. When they do not all fit in one
+// response the status is "Truncated: <shown> of <total> matches"
+void search_files(int client_socket, struct User client, const char *query)
+{
+    if (strlen(query) < SEARCH_MIN_QUERY)
+    {
+        // 沒有 trigram 的話每個檔案都是候選，得全部讀一遍
+        Response res;
+        format_response(&res, "Query too short", "Search text needs at least 3 characters.");
+        send(client_socket, &res, sizeof(res), 0);
+        log_add(client.name, client.group, "search", query, 0, "query too short", "", "");
+        return;
+    }
+
+    struct SearchCandidates candidates = {NULL, 0, 0};
+    search_index_query(query, collect_candidate, &candidates);
+
+    // index 可能有誤判 (trigram 都在但不相連)，逐一讀檔確認
+    char names[BUFFER_SIZE] = {0};
+    size_t used = 0;
+    int matches = 0, shown = 0;
+    for (int c = 0; c < candidates.count; c++)
+    {
+        int i = find_capability(candidates.names[c]);
+        if (i < 0 || !can_read(&capabilities[i], client) || !file_contains(i, query))
+            continue;
+
+        matches++;
+        size_t len = strlen(capabilities[i].filename) + 1;
+        if (used + len < sizeof(names))
+        {
+            used += snprintf(names + used, sizeof(names) - used, "%s\n", capabilities[i].filename);
+            shown++;
+        }
+    }
+    free(candidates.names);
+
+    char detail[64];
+    snprintf(detail, sizeof(detail), "%d matches", matches);
+    log_add(client.name, client.group, "search", query, 0, detail, "", "");
+
+    char status[64] = "SUCCESS";
+    if (shown < matches)
+        snprintf(status, sizeof(status), "Truncated: %d of %d matches", shown, matches);
+    Response res;
+    format_response(&res, status, names);
+    send(client_socket, &res, sizeof(res), 0);
+}
+
 // Client handler
 void *handle_client(void *client_socket_ptr)
 {
     int client_socket = *(int *)client_socket_ptr;
+    free(client_socket_ptr);
     ClientRequest request;
 
     Response res;
@@ -424,19 +1277,70 @@ void *handle_client(void *client_socket_ptr)
         struct User client = request.user;
         char *command = request.command;
 
-        char filename[MAX_FILENAME], permissions[PERMISSION_LEN], write_mode[2];
+        char filename[MAX_FILENAME], permissions[PERMISSION_LEN + 1], write_mode[2];
+        int start;
 
         if (strlen(command) == 0)
         {
             format_response(&res, "INFO", "No command received.");
             send(client_socket, &res, sizeof(res), 0);
         }
+        else if (!rate_limit_allow_op(client.name, client.group))
+        {
+            format_response(&res, "Rate limited", "");
+            send(client_socket, &res, sizeof(res), 0);
+        }
         else if (strcmp(command, "ls") == 0)
         {
-            char response[1024] = {0};
-            format_response(&res, "SUCCESS", response);
+            list_files(client_socket);
+        }
+        else if (!strncmp(command, "search ", 7) && command[7] != '\0')
+        {
+            search_files(client_socket, client, command + 7);
+        }
+        else if (sscanf(command, "watch %255s", filename) == 1)
+        {
+            // 連線進入 watch 模式，client 送下一個 request (例如 unwatch) 才回到一般模式
+            if (!watch_serve(client_socket, client, filename))
+                break;
+        }
+        else if (strcmp(command, "stats") == 0)
+        {
+            char stats[BUFFER_SIZE];
+            repl_status(stats, sizeof(stats));
+            size_t used = strlen(stats);
+            used += snprintf(stats + used, sizeof(stats) - used, "watchers: %d\n", watch_subscriber_count());
+            chunk_store_status(stats + used, sizeof(stats) - used);
+            format_response(&res, "SUCCESS", stats);
+            send(client_socket, &res, sizeof(res), 0);
+        }
+        else if (repl_is_standby() && (!strncmp(command, "create ", 7) || !strncmp(command, "write ", 6) || !strncmp(command, "mode ", 5) ||
+                                       !strncmp(command, "import ", 7) || !strncmp(command, "drop ", 5)))
+        {
+            // standby 只提供讀取
+            format_response(&res, "Read-only standby", "");
             send(client_socket, &res, sizeof(res), 0);
         }
+        else if (is_admin(client) && sscanf(command, "names %d", &start) == 1)
+        {
+            list_names(client_socket, start);
+        }
+        else if (is_admin(client) && sscanf(command, "export %255s", filename) == 1)
+        {
+            export_file(client_socket, client, filename);
+        }
+        else if (is_admin(client) && !strncmp(command, "import ", 7))
+        {
+            import_file(client_socket, client, command + 7);
+        }
+        else if (is_admin(client) && sscanf(command, "drop %255s", filename) == 1)
+        {
+            drop_file(client_socket, client, filename);
+        }
+        else if (is_admin(client) && sscanf(command, "thaw %255s", filename) == 1)
+        {
+            thaw_file(client_socket, filename);
+        }
         else if (sscanf(command, "create %s %s", filename, permissions) == 2)
         {
             if (is_valid_permissions(permissions))
@@ -480,40 +1384,78 @@ void *handle_client(void *client_socket_ptr)
     return NULL;
 }
 
-int main()
+// One listening socket and its accept loop
+struct Acceptor
 {
-    int server_socket, client_socket;
-    struct sockaddr_in server_address;
-    pthread_t thread_id;
+    int id;
+    int listen_fd;
+    int cpu; // -1: 不綁定 CPU
+};
 
-    create_storage_dir();
+// Create a listening socket; with reuseport every acceptor binds its own socket to the same port
+int open_listener(int port, int backlog, bool reuseport)
+{
+    struct sockaddr_in server_address;
 
     // 建 server socket
-    server_socket = socket(AF_INET, SOCK_STREAM, 0);
+    int server_socket = socket(AF_INET, SOCK_STREAM, 0);
     if (server_socket < 0)
-        exit(1);
+    {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    int on = 1;
+    if (reuseport && setsockopt(server_socket, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0)
+    {
+        perror("SO_REUSEPORT failed");
+        close(server_socket);
+        return -1;
+    }
 
     // 設定 server address
+    memset(&server_address, 0, sizeof(server_address));
     server_address.sin_family = AF_INET;
-    server_address.sin_port = htons(9003);
+    server_address.sin_port = htons(port);
     server_address.sin_addr.s_addr = INADDR_ANY;
 
     if (bind(server_socket, (struct sockaddr *)&server_address, sizeof(server_address)) < 0)
     {
         perror("Bind failed");
-        exit(1);
+        close(server_socket);
+        return -1;
     }
 
-    if (listen(server_socket, MAX_CLIENTS) < 0)
+    if (listen(server_socket, backlog) < 0)
     {
         perror("Listen failed");
-        exit(1);
+        close(server_socket);
+        return -1;
+    }
+    return server_socket;
+}
+
+void *accept_loop(void *arg)
+{
+    struct Acceptor *acceptor = arg;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    // Pin the acceptor and every connection thread it spawns to the same core
+    if (acceptor->cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(acceptor->cpu, &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+            fprintf(stderr, "Acceptor %d: failed to pin to CPU %d\n", acceptor->id, acceptor->cpu);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
     }
-    printf("Server is running and waiting for connections...\n");
 
     while (1)
     {
-        client_socket = accept(server_socket, NULL, NULL); // 接受客戶端連線
+        int client_socket = accept(acceptor->listen_fd, NULL, NULL); // 接受客戶端連線
         if (client_socket < 0)
         {
             perror("Accept failed");
@@ -530,15 +1472,226 @@ int main()
         *socket_ptr = client_socket;
 
         // 建立新的執行緒處理客戶端請求
-        if (pthread_create(&thread_id, NULL, handle_client, (void *)socket_ptr) != 0)
+        pthread_t thread_id;
+        if (pthread_create(&thread_id, &attr, handle_client, (void *)socket_ptr) != 0)
         {
             perror("Thread creation failed");
             close(client_socket);
             free(socket_ptr);
         }
+    }
+
+    pthread_attr_destroy(&attr);
+    return NULL;
+}
+
+// Number of CPUs this process may run on
+int allowed_cpu_count(void)
+{
+    cpu_set_t cpus;
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0)
+        return CPU_COUNT(&cpus);
+    return (int)sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [--uring] [--reuseport[=N]] [--pin] [--backlog N] [--limits FILE]\n"
+                    "          [--port N] [--dir DIR] [--chunked] [--repl-port N | --standby-of HOST:PORT]\n", prog);
+    fprintf(stderr, "  --uring          serve file I/O through io_uring (falls back to threads if unavailable)\n");
+    fprintf(stderr, "  --reuseport[=N]  N SO_REUSEPORT listeners with their own accept loop (default: one per core)\n");
+    fprintf(stderr, "  --pin            with --reuseport, pin each acceptor and its connection threads to one allowed core\n");
+    fprintf(stderr, "  --backlog N      listen backlog (default %d)\n", MAX_CLIENTS);
+    fprintf(stderr, "  --limits FILE    per-user / per-group rate limits and storage quotas\n");
+    fprintf(stderr, "  --port N         client port (default %d)\n", PORT);
+    fprintf(stderr, "  --dir DIR        storage directory (default %s)\n", FILE_DIR);
+    fprintf(stderr, "  --chunked        store files as deduplicated content-defined chunks (no io_uring)\n");
+    fprintf(stderr, "  --repl-port N    run as primary and ship changes to standbys connecting on port N\n");
+    fprintf(stderr, "  --standby-of H:P run as read-only standby of the primary's replication port\n");
+}
+
+int main(int argc, char *argv[])
+{
+    bool use_uring = false;
+    bool chunked = false;
+    int port = PORT;
+    int repl_port = 0;
+    char standby_host[64] = {0};
+    int standby_port = 0;
+    bool reuseport = false;
+    bool pin = false;
+    int acceptor_count = 1;
+    int backlog = MAX_CLIENTS;
+
+    static struct option long_options[] = {
+        {"uring", no_argument, NULL, 'u'},
+        {"reuseport", optional_argument, NULL, 'r'},
+        {"pin", no_argument, NULL, 'p'},
+        {"backlog", required_argument, NULL, 'b'},
+        {"limits", required_argument, NULL, 'l'},
+        {"port", required_argument, NULL, 'P'},
+        {"dir", required_argument, NULL, 'd'},
+        {"chunked", no_argument, NULL, 'c'},
+        {"repl-port", required_argument, NULL, 'R'},
+        {"standby-of", required_argument, NULL, 'S'},
+        {NULL, 0, NULL, 0}};
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'u':
+            use_uring = true;
+            break;
+        case 'r':
+            reuseport = true;
+            acceptor_count = optarg ? atoi(optarg) : allowed_cpu_count();
+            if (acceptor_count < 1 || acceptor_count > MAX_ACCEPTORS)
+            {
+                fprintf(stderr, "Invalid acceptor count (1-%d)\n", MAX_ACCEPTORS);
+                exit(1);
+            }
+            break;
+        case 'p':
+            pin = true;
+            break;
+        case 'b':
+            backlog = atoi(optarg);
+            if (backlog <= 0)
+            {
+                fprintf(stderr, "Invalid backlog\n");
+                exit(1);
+            }
+            break;
+        case 'l':
+            if (rate_limit_load(optarg) < 0)
+                exit(1);
+            printf("Rate limits loaded from %s\n", optarg);
+            break;
+        case 'P':
+            port = atoi(optarg);
+            break;
+        case 'd':
+            snprintf(storage_dir, sizeof(storage_dir), "%s", optarg);
+            break;
+        case 'c':
+            chunked = true;
+            break;
+        case 'R':
+            repl_port = atoi(optarg);
+            break;
+        case 'S':
+            if (sscanf(optarg, "%63[^:]:%d", standby_host, &standby_port) != 2)
+            {
+                fprintf(stderr, "Use --standby-of HOST:PORT\n");
+                exit(1);
+            }
+            break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (pin && !reuseport)
+    {
+        // 只有一個 acceptor 時綁核會讓所有連線 thread 擠在同一顆 CPU 上
+        fprintf(stderr, "--pin requires --reuseport\n");
+        exit(1);
+    }
+
+    if (repl_port && standby_port)
+    {
+        fprintf(stderr, "--repl-port and --standby-of cannot be combined\n");
+        exit(1);
+    }
+
+    // 連線可能在回覆前就斷了，不要讓 SIGPIPE 結束 server
+    signal(SIGPIPE, SIG_IGN);
+
+    create_storage_dir();
+    fd_cache_init();
+    if (search_index_open(storage_dir) < 0)
+        exit(1);
+    if (chunked && chunk_store_open(storage_dir) < 0)
+        exit(1);
+
+    // chunk 的讀寫走同步路徑
+    if (use_uring && chunked)
+    {
+        printf("io_uring is not used with --chunked\n");
+        use_uring = false;
+    }
+    if (use_uring)
+    {
+        if (uring_io_init(URING_ENTRIES) == 0)
+            printf("io_uring I/O engine enabled\n");
+        else
+            printf("io_uring not available, using threaded I/O\n");
+    }
+
+    if (repl_port)
+    {
+        if (repl_primary_start(repl_port, repl_snapshot) < 0)
+            exit(1);
+        printf("Primary: standbys replicate from port %d\n", repl_port);
+    }
+    else if (standby_port)
+    {
+        if (repl_standby_start(standby_host, standby_port, repl_apply) < 0)
+            exit(1);
+        printf("Standby of %s:%d (read-only)\n", standby_host, standby_port);
+    }
+
+    // 每個 acceptor 有自己的 listener，由 kernel 分配連線，不需要共用的 accept lock
+    static struct Acceptor acceptors[MAX_ACCEPTORS];
+
+    // 只用這個 process 被允許的 CPU (taskset / cgroup 可能限制成不連號的一組)
+    int allowed[CPU_SETSIZE];
+    int cpu_count = 0;
+    cpu_set_t cpus;
+    if (pin && sched_getaffinity(0, sizeof(cpus), &cpus) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &cpus))
+                allowed[cpu_count++] = cpu;
+        }
+    }
+    if (pin && cpu_count == 0)
+    {
+        perror("sched_getaffinity");
+        exit(1);
+    }
+
+    for (int i = 0; i < acceptor_count; i++)
+    {
+        acceptors[i].id = i;
+        acceptors[i].cpu = pin ? allowed[i % cpu_count] : -1;
+        acceptors[i].listen_fd = open_listener(port, backlog, reuseport);
+        if (acceptors[i].listen_fd < 0)
+            exit(1);
+    }
+
+    if (reuseport)
+        printf("Server is running with %d SO_REUSEPORT acceptors (backlog %d)\n", acceptor_count, backlog);
+    else
+        printf("Server is running and waiting for connections...\n");
+
+    for (int i = 1; i < acceptor_count; i++)
+    {
+        pthread_t thread_id;
+        if (pthread_create(&thread_id, NULL, accept_loop, &acceptors[i]) != 0)
+        {
+            perror("Acceptor creation failed");
+            exit(1);
+        }
         pthread_detach(thread_id);
     }
+    accept_loop(&acceptors[0]);
 
-    close(server_socket);
+    for (int i = 0; i < acceptor_count; i++)
+        close(acceptors[i].listen_fd);
     return 0;
 }
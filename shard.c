@@ -0,0 +1,118 @@
+#include "shard.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint64_t shard_hash(const char *key)
+{
+    // FNV-1a, then a splitmix64 finalizer so similar names spread over the ring
+    uint64_t h = 14695981039346656037ULL;
+    for (; *key; key++)
+    {
+        h ^= (unsigned char)*key;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+static int compare_points(const void *a, const void *b)
+{
+    const RingPoint *x = a, *y = b;
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    return x->shard - y->shard;
+}
+
+int shard_map_load(const char *path, ShardMap *map)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        perror("Failed to open shard map");
+        return -1;
+    }
+
+    memset(map, 0, sizeof(*map));
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        line_no++;
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0')
+            continue;
+
+        if (map->count >= MAX_SHARDS)
+        {
+            fprintf(stderr, "%s: more than %d shards\n", path, MAX_SHARDS);
+            fclose(file);
+            return -1;
+        }
+
+        ShardEndpoint *shard = &map->shards[map->count];
+        if (sscanf(p, "%63[^:]:%d", shard->host, &shard->port) != 2)
+        {
+            fprintf(stderr, "%s:%d: expected host:port\n", path, line_no);
+            fclose(file);
+            return -1;
+        }
+        map->count++;
+    }
+    fclose(file);
+
+    if (map->count == 0)
+    {
+        fprintf(stderr, "%s: no shards\n", path);
+        return -1;
+    }
+
+    // 每台 server 在 ring 上放 SHARD_VNODES 個點，點的位置只跟 endpoint 有關，
+    // 所以增減 server 時只有相鄰區段的檔案需要搬
+    for (int s = 0; s < map->count; s++)
+    {
+        for (int v = 0; v < SHARD_VNODES; v++)
+        {
+            char key[96];
+            snprintf(key, sizeof(key), "%s:%d#%d", map->shards[s].host, map->shards[s].port, v);
+            map->ring[map->points].hash = shard_hash(key);
+            map->ring[map->points].shard = s;
+            map->points++;
+        }
+    }
+    qsort(map->ring, map->points, sizeof(RingPoint), compare_points);
+    return 0;
+}
+
+int shard_owner(const ShardMap *map, const char *filename)
+{
+    uint64_t h = shard_hash(filename);
+
+    // First point clockwise from h
+    int lo = 0, hi = map->points;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (map->ring[mid].hash < h)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == map->points)
+        lo = 0;
+    return map->ring[lo].shard;
+}
+
+int shard_find(const ShardMap *map, const ShardEndpoint *endpoint)
+{
+    for (int i = 0; i < map->count; i++)
+    {
+        if (map->shards[i].port == endpoint->port && !strcmp(map->shards[i].host, endpoint->host))
+            return i;
+    }
+    return -1;
+}
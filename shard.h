@@ -0,0 +1,41 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdint.h>
+
+#define MAX_SHARDS 32
+#define SHARD_VNODES 128 // virtual nodes per server on the hash ring
+
+typedef struct
+{
+    char host[64];
+    int port;
+} ShardEndpoint;
+
+typedef struct
+{
+    uint64_t hash;
+    int shard;
+} RingPoint;
+
+// Shard map: the servers plus the consistent-hash ring built from them
+typedef struct
+{
+    ShardEndpoint shards[MAX_SHARDS];
+    int count;
+    RingPoint ring[MAX_SHARDS * SHARD_VNODES];
+    int points;
+} ShardMap;
+
+// Load a shard map file with one "host:port" per line ('#' starts a comment)
+int shard_map_load(const char *path, ShardMap *map);
+
+// Index into map->shards of the server that owns `filename`
+int shard_owner(const ShardMap *map, const char *filename);
+
+// Index of the shard with the same endpoint in `map`, or -1
+int shard_find(const ShardMap *map, const ShardEndpoint *endpoint);
+
+uint64_t shard_hash(const char *key);
+
+#endif
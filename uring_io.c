@@ -0,0 +1,335 @@
+#include "uring_io.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Submission / completion ring mapped from the kernel
+struct Ring
+{
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_entries;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    unsigned cq_entries;
+    struct io_uring_cqe *cqes;
+};
+
+static struct Ring ring;
+static bool enabled = false;
+
+// sq_lock 保護 SQ tail、pending 與 inflight
+static pthread_mutex_t sq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sq_space = PTHREAD_COND_INITIALIZER;
+static unsigned pending = 0;  // pushed into the SQ but not yet handed to the kernel
+static unsigned inflight = 0; // submitted but not yet reaped, bounded by the CQ size
+static bool flushing = false;
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// Check that the kernel knows every opcode we use (OPENAT/READ/WRITE need 5.6+)
+static bool probe_opcodes(int fd)
+{
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    if (probe == NULL)
+        return false;
+
+    bool ok = false;
+    if (sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0)
+    {
+        int ops[] = {IORING_OP_READ, IORING_OP_WRITE, IORING_OP_FSYNC, IORING_OP_OPENAT};
+        ok = true;
+        for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+        {
+            if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+                ok = false;
+        }
+    }
+    free(probe);
+    return ok;
+}
+
+// Reap completions and run their callbacks
+static void *completion_loop(void *arg)
+{
+    (void)arg;
+    while (1)
+    {
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail)
+        {
+            if (sys_io_uring_enter(ring.fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+                perror("io_uring_enter (wait) failed");
+            continue;
+        }
+
+        while (head != tail)
+        {
+            struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+            UringReq *req = (UringReq *)(uintptr_t)cqe->user_data;
+            int res = cqe->res;
+            head++;
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+
+            pthread_mutex_lock(&sq_lock);
+            inflight--;
+            pthread_cond_broadcast(&sq_space);
+            pthread_mutex_unlock(&sq_lock);
+
+            req->result = res;
+            if (req->callback)
+                req->callback(req); // callback 可能會釋放 req
+        }
+    }
+    return NULL;
+}
+
+int uring_io_init(unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    int fd = sys_io_uring_setup(entries, &p);
+    if (fd < 0)
+        return -1;
+
+    if (!probe_opcodes(fd))
+    {
+        close(fd);
+        return -1;
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && cq_size > sq_size)
+        sq_size = cq_size;
+
+    void *sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+
+    void *cq_ptr = sq_ptr;
+    if (!single_mmap)
+    {
+        cq_ptr = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED)
+        {
+            munmap(sq_ptr, sq_size);
+            close(fd);
+            return -1;
+        }
+    }
+
+    void *sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        munmap(sq_ptr, sq_size);
+        if (!single_mmap)
+            munmap(cq_ptr, cq_size);
+        close(fd);
+        return -1;
+    }
+
+    ring.fd = fd;
+    ring.sq_head = (unsigned *)((char *)sq_ptr + p.sq_off.head);
+    ring.sq_tail = (unsigned *)((char *)sq_ptr + p.sq_off.tail);
+    ring.sq_mask = (unsigned *)((char *)sq_ptr + p.sq_off.ring_mask);
+    ring.sq_array = (unsigned *)((char *)sq_ptr + p.sq_off.array);
+    ring.sq_entries = p.sq_entries;
+    ring.sqes = sqes;
+    ring.cq_head = (unsigned *)((char *)cq_ptr + p.cq_off.head);
+    ring.cq_tail = (unsigned *)((char *)cq_ptr + p.cq_off.tail);
+    ring.cq_mask = (unsigned *)((char *)cq_ptr + p.cq_off.ring_mask);
+    ring.cq_entries = p.cq_entries;
+    ring.cqes = (struct io_uring_cqe *)((char *)cq_ptr + p.cq_off.cqes);
+
+    pthread_t thread_id;
+    if (pthread_create(&thread_id, NULL, completion_loop, NULL) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    pthread_detach(thread_id);
+
+    enabled = true;
+    return 0;
+}
+
+bool uring_io_enabled(void)
+{
+    return enabled;
+}
+
+static void prep_sqe(struct io_uring_sqe *sqe, UringReq *req, bool link)
+{
+    memset(sqe, 0, sizeof(*sqe));
+    switch (req->op)
+    {
+    case URING_READ:
+        sqe->opcode = IORING_OP_READ;
+        break;
+    case URING_WRITE:
+        sqe->opcode = IORING_OP_WRITE;
+        break;
+    case URING_FSYNC:
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        break;
+    case URING_OPENAT:
+        sqe->opcode = IORING_OP_OPENAT;
+        break;
+    }
+
+    if (req->op == URING_OPENAT)
+    {
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uintptr_t)req->path;
+        sqe->open_flags = req->flags;
+        sqe->len = 0644;
+    }
+    else
+    {
+        sqe->fd = req->fd;
+        sqe->addr = (uintptr_t)req->buf;
+        sqe->len = req->len;
+        sqe->off = req->offset;
+    }
+    if (link)
+        sqe->flags |= IOSQE_IO_LINK;
+    sqe->user_data = (uintptr_t)req;
+}
+
+int uring_io_submit(UringReq **reqs, int n)
+{
+    if (!enabled || n <= 0 || (unsigned)n > ring.sq_entries)
+        return -1;
+
+    pthread_mutex_lock(&sq_lock);
+
+    // 等待 SQ 有空位，並限制 inflight 不超過 CQ 大小
+    while (ring.sq_entries - (*ring.sq_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE)) < (unsigned)n ||
+           inflight + n > ring.cq_entries)
+    {
+        pthread_cond_wait(&sq_space, &sq_lock);
+    }
+
+    unsigned tail = *ring.sq_tail;
+    for (int i = 0; i < n; i++)
+    {
+        unsigned idx = tail & *ring.sq_mask;
+        prep_sqe(&ring.sqes[idx], reqs[i], i < n - 1);
+        ring.sq_array[idx] = idx;
+        tail++;
+    }
+    __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+    pending += n;
+    inflight += n;
+
+    // Whoever is already flushing also picks up our entries, so concurrent
+    // requests reach the kernel in a single io_uring_enter
+    if (!flushing)
+    {
+        flushing = true;
+        while (pending > 0)
+        {
+            unsigned to_submit = pending;
+            pending = 0;
+            pthread_mutex_unlock(&sq_lock);
+
+            int ret = sys_io_uring_enter(ring.fd, to_submit, 0, 0);
+
+            pthread_mutex_lock(&sq_lock);
+            if (ret < 0)
+            {
+                if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                    perror("io_uring_enter (submit) failed");
+                pending += to_submit;
+                if (errno != EINTR)
+                {
+                    // Let the completion thread drain the CQ before retrying
+                    pthread_mutex_unlock(&sq_lock);
+                    usleep(100);
+                    pthread_mutex_lock(&sq_lock);
+                }
+            }
+            else if ((unsigned)ret < to_submit)
+            {
+                pending += to_submit - ret;
+            }
+        }
+        flushing = false;
+        pthread_cond_broadcast(&sq_space);
+    }
+
+    pthread_mutex_unlock(&sq_lock);
+    return 0;
+}
+
+// Waiter used by uring_io_run / uring_io_run_chain
+struct RunWaiter
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int remaining;
+};
+
+static void run_done(UringReq *req)
+{
+    struct RunWaiter *waiter = req->ctx;
+    pthread_mutex_lock(&waiter->lock);
+    if (--waiter->remaining == 0)
+        pthread_cond_signal(&waiter->cond);
+    pthread_mutex_unlock(&waiter->lock);
+}
+
+int uring_io_run_chain(UringReq **reqs, int n)
+{
+    struct RunWaiter waiter = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, n};
+    for (int i = 0; i < n; i++)
+    {
+        reqs[i]->callback = run_done;
+        reqs[i]->ctx = &waiter;
+    }
+
+    if (uring_io_submit(reqs, n) < 0)
+        return -EIO;
+
+    pthread_mutex_lock(&waiter.lock);
+    while (waiter.remaining > 0)
+        pthread_cond_wait(&waiter.cond, &waiter.lock);
+    pthread_mutex_unlock(&waiter.lock);
+    return 0;
+}
+
+int uring_io_run(UringReq *req)
+{
+    int rc = uring_io_run_chain(&req, 1);
+    return rc < 0 ? rc : req->result;
+}
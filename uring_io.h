@@ -0,0 +1,48 @@
+#ifndef URING_IO_H
+#define URING_IO_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define URING_ENTRIES 256
+
+enum UringOp
+{
+    URING_READ,
+    URING_WRITE,
+    URING_FSYNC,
+    URING_OPENAT
+};
+
+typedef struct UringReq UringReq;
+typedef void (*uring_cb)(UringReq *req);
+
+// One I/O request; must stay alive until its callback runs on the completion thread
+struct UringReq
+{
+    enum UringOp op;
+    int fd;
+    const char *path; // URING_OPENAT
+    int flags;        // open flags for URING_OPENAT
+    void *buf;
+    unsigned len;
+    off_t offset;
+    int result; // bytes / new fd on success, -errno on failure
+    uring_cb callback;
+    void *ctx;
+};
+
+// Set up the ring and its completion thread; -1 if the kernel has no io_uring
+int uring_io_init(unsigned entries);
+bool uring_io_enabled(void);
+
+// Queue `n` requests as one linked chain (each starts after the previous succeeds)
+int uring_io_submit(UringReq **reqs, int n);
+
+// Submit a single request and block the caller until it completes (overrides req->callback/ctx)
+int uring_io_run(UringReq *req);
+
+// Submit a linked chain and block until every request has completed; results are in each req
+int uring_io_run_chain(UringReq **reqs, int n);
+
+#endif
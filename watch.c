@@ -0,0 +1,228 @@
+#define _GNU_SOURCE // pipe2
+#include "watch.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Operations seen on one file since the subscriber was last sent its events
+#define OP_CREATE 1
+#define OP_WRITE 2
+#define OP_MODE 4
+
+struct PendingEvent
+{
+    WatchEvent event; // latest state of the file
+    unsigned ops;     // every OP_* since the last send
+};
+
+struct Subscriber
+{
+    int socket;
+    struct User user;
+    char pattern[256];
+    bool prefix;
+
+    pthread_mutex_t lock;
+    struct PendingEvent queue[WATCH_QUEUE_LEN]; // 每個檔案最多一筆，合併成最新狀態 + 所有 op
+    int count;
+    bool overflow; // queue 滿了丟過事件，client 要自己重新同步
+    int wake[2];   // pipe: 空 queue 變成非空時寫一個 byte
+
+    struct Subscriber *next;
+};
+
+static struct Subscriber *subscribers = NULL;
+static pthread_mutex_t subscribers_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int subscriber_count = 0;
+
+static bool matches(const struct Subscriber *sub, const char *filename)
+{
+    if (sub->prefix)
+        return !strncmp(filename, sub->pattern, strlen(sub->pattern));
+    return !strcmp(filename, sub->pattern);
+}
+
+static unsigned op_bit(const char *op)
+{
+    return !strcmp(op, "create") ? OP_CREATE : !strcmp(op, "write") ? OP_WRITE : OP_MODE;
+}
+
+// "create,write,mode" order, e.g. a write followed by a mode change is "write,mode"
+static void format_ops(unsigned ops, char *buf, size_t len)
+{
+    snprintf(buf, len, "%s%s%s%s%s", ops & OP_CREATE ? "create" : "",
+             (ops & OP_CREATE) && (ops & (OP_WRITE | OP_MODE)) ? "," : "", ops & OP_WRITE ? "write" : "",
+             (ops & OP_WRITE) && (ops & OP_MODE) ? "," : "", ops & OP_MODE ? "mode" : "");
+}
+
+static void enqueue(struct Subscriber *sub, const WatchEvent *event)
+{
+    pthread_mutex_lock(&sub->lock);
+    bool was_empty = sub->count == 0 && !sub->overflow;
+
+    int i = 0;
+    while (i < sub->count && strcmp(sub->queue[i].event.filename, event->filename) != 0)
+        i++;
+    if (i < sub->count)
+    {
+        // Coalesce: latest state of the file, plus every kind of change since the last send
+        sub->queue[i].event = *event;
+        sub->queue[i].ops |= op_bit(event->op);
+    }
+    else if (sub->count < WATCH_QUEUE_LEN)
+    {
+        sub->queue[sub->count].event = *event;
+        sub->queue[sub->count].ops = op_bit(event->op);
+        sub->count++;
+    }
+    else
+        sub->overflow = true;
+
+    if (was_empty)
+    {
+        char byte = 1;
+        if (write(sub->wake[1], &byte, 1) < 0 && errno != EAGAIN)
+            perror("Failed to wake watcher");
+    }
+    pthread_mutex_unlock(&sub->lock);
+}
+
+void watch_notify(const WatchEvent *event, watch_filter_fn filter, void *arg)
+{
+    if (atomic_load(&subscriber_count) == 0)
+        return;
+
+    pthread_mutex_lock(&subscribers_lock);
+    for (struct Subscriber *sub = subscribers; sub; sub = sub->next)
+    {
+        if (matches(sub, event->filename) && (filter == NULL || filter(sub->user, arg)))
+            enqueue(sub, event);
+    }
+    pthread_mutex_unlock(&subscribers_lock);
+}
+
+int watch_subscriber_count(void)
+{
+    return atomic_load(&subscriber_count);
+}
+
+static void unsubscribe(struct Subscriber *sub)
+{
+    pthread_mutex_lock(&subscribers_lock);
+    for (struct Subscriber **p = &subscribers; *p; p = &(*p)->next)
+    {
+        if (*p == sub)
+        {
+            *p = sub->next;
+            break;
+        }
+    }
+    atomic_fetch_sub(&subscriber_count, 1);
+    pthread_mutex_unlock(&subscribers_lock);
+
+    close(sub->wake[0]);
+    close(sub->wake[1]);
+    pthread_mutex_destroy(&sub->lock);
+    free(sub);
+}
+
+static bool send_response(int socket, const char *status, const char *content)
+{
+    Response res;
+    memset(&res, 0, sizeof(res));
+    snprintf(res.status, sizeof(res.status), "%s", status);
+    snprintf(res.content, sizeof(res.content), "%s", content);
+    return send(socket, &res, sizeof(res), MSG_NOSIGNAL) == sizeof(res);
+}
+
+// Read the rest of a request the client sent while watching
+static bool drain_request(int socket)
+{
+    ClientRequest request;
+    size_t got = 0;
+    while (got < sizeof(request))
+    {
+        ssize_t n = recv(socket, (char *)&request + got, sizeof(request) - got, 0);
+        if (n <= 0)
+            return false;
+        got += n;
+    }
+    return true;
+}
+
+bool watch_serve(int client_socket, struct User user, const char *pattern)
+{
+    struct Subscriber *sub = calloc(1, sizeof(*sub));
+    if (sub == NULL || pipe2(sub->wake, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        free(sub);
+        return send_response(client_socket, "Failed to watch", "");
+    }
+    sub->socket = client_socket;
+    sub->user = user;
+    snprintf(sub->pattern, sizeof(sub->pattern), "%s", pattern);
+    size_t len = strlen(sub->pattern);
+    if (len > 0 && sub->pattern[len - 1] == '*')
+    {
+        sub->pattern[len - 1] = '\0';
+        sub->prefix = true;
+    }
+    pthread_mutex_init(&sub->lock, NULL);
+
+    pthread_mutex_lock(&subscribers_lock);
+    sub->next = subscribers;
+    subscribers = sub;
+    atomic_fetch_add(&subscriber_count, 1);
+    pthread_mutex_unlock(&subscribers_lock);
+
+    bool open = send_response(client_socket, "Watching", pattern);
+    while (open)
+    {
+        // 等新事件，或 client 送來下一個 request / 斷線
+        struct pollfd fds[2] = {{sub->wake[0], POLLIN, 0}, {client_socket, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            open = false;
+            break;
+        }
+
+        if (fds[1].revents)
+        {
+            open = drain_request(client_socket) && send_response(client_socket, "Watch stopped", pattern);
+            break;
+        }
+
+        char drain[64];
+        while (read(sub->wake[0], drain, sizeof(drain)) > 0)
+            ;
+
+        // 複製出來再送，送的時候不擋住 publisher
+        struct PendingEvent batch[WATCH_QUEUE_LEN];
+        pthread_mutex_lock(&sub->lock);
+        int count = sub->count;
+        bool overflow = sub->overflow;
+        memcpy(batch, sub->queue, count * sizeof(struct PendingEvent));
+        sub->count = 0;
+        sub->overflow = false;
+        pthread_mutex_unlock(&sub->lock);
+
+        if (overflow)
+            open = send_response(client_socket, "Events dropped", "Watch queue overflowed, run ls to resync");
+        for (int i = 0; i < count && open; i++)
+        {
+            const WatchEvent *event = &batch[i].event;
+            char ops[32];
+            format_ops(batch[i].ops, ops, sizeof(ops));
+            char content[BUFFER_SIZE];
+            snprintf(content, sizeof(content), "%s %s %lu %s %s", ops, event->filename,
+                     (unsigned long)event->size, event->last_modified, event->writer);
+            open = send_response(client_socket, "EVENT", content);
+        }
+    }
+
+    unsubscribe(sub);
+    return open;
+}
@@ -0,0 +1,30 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "includes.h"
+
+#define WATCH_QUEUE_LEN 64 // distinct files pending per subscriber
+
+// A committed change pushed to subscribers
+typedef struct
+{
+    char op[8]; // create / write / mode; pending events of one file are merged into a set
+    char filename[256];
+    size_t size;
+    char last_modified[20];
+    char writer[256];
+} WatchEvent;
+
+// Decides whether `user` may see the event (read permission on the file)
+typedef bool (*watch_filter_fn)(struct User user, void *arg);
+
+// Queue `event` for every matching subscriber allowed by `filter`. Never blocks on a slow subscriber
+void watch_notify(const WatchEvent *event, watch_filter_fn filter, void *arg);
+
+// Serve a `watch <pattern>` subscription on `client_socket` (trailing '*' = prefix) until the
+// client sends another request or disconnects. Returns true if the connection is still usable
+bool watch_serve(int client_socket, struct User user, const char *pattern);
+
+int watch_subscriber_count(void);
+
+#endif